@@ -0,0 +1,95 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    bench/frustum.cpp
+//
+// DESCRIPTION:
+// -----------
+// Benchmark of the batch frustum tests: culls 1M bounding spheres and boxes
+// scattered around the camera, and checks the results against the tests of
+// one volume at a time.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/camera.hpp"
+
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+
+const size_t COUNT  = 1000000;
+const int    ROUNDS = 50;
+
+
+template <class F>
+static double measure(F cull) {
+    double best = 1e9;
+    for (int i = 0; i < ROUNDS; i++) {
+        auto start = chrono::steady_clock::now();
+        cull();
+        best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+
+int main(int argc, char* argv[]) {
+    size_t count = (argc > 1) ? strtoul(argv[1], nullptr, 10) : COUNT;
+
+    QGlCamera camera(glm::vec3(0.0f, 0.0f, 0.0f));
+    camera.withFarPlane(200.0f);
+    QGlFrustum frustum = camera.getFrustum();
+
+    mt19937 random(31);
+    uniform_real_distribution<float> position(-200.0f, 200.0f), size(0.1f, 5.0f);
+    QGlSpheres spheres;
+    QGlBoxes   boxes;
+    spheres.reserve(count);
+    boxes.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 center(position(random), position(random), position(random));
+        float     r = size(random);
+        spheres.add(center, r);
+        boxes.add(center - glm::vec3(r), center + glm::vec3(r));
+    }
+
+    vector<uint32_t> visible;
+    visible.reserve(count + 8);
+    printf("%zu volumes, %s\n", count, QGlFrustum::getInstructionSet());
+
+    double ms = measure([&]() { frustum.cullSpheres(spheres, visible); });
+    size_t errors = 0, n = 0;
+    for (size_t i = 0; i < count; i++) {
+        bool inside = frustum.testSphere(glm::vec3(spheres.x[i], spheres.y[i], spheres.z[i]), spheres.radius[i]);
+        errors += (inside != (n < visible.size() && visible[n] == i));
+        n += (n < visible.size() && visible[n] == i);
+    }
+    printf("spheres: %8.3f ms, %zu visible, %zu errors\n", ms, visible.size(), errors);
+
+    ms = measure([&]() { frustum.cullBoxes(boxes, visible); });
+    size_t boxErrors = 0;
+    n = 0;
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 lo(boxes.minX[i], boxes.minY[i], boxes.minZ[i]), hi(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]);
+        bool inside = frustum.testBox(lo, hi);
+        boxErrors += (inside != (n < visible.size() && visible[n] == i));
+        n += (n < visible.size() && visible[n] == i);
+    }
+    printf("boxes:   %8.3f ms, %zu visible, %zu errors\n", ms, visible.size(), boxErrors);
+
+    return (errors + boxErrors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
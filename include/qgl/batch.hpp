@@ -0,0 +1,136 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    batch.hpp
+//
+// DESCRIPTION:
+// -----------
+// Instanced batch renderer: draws are recorded, sorted by program, mesh and
+// material, and issued as one instanced draw per unique combination, with the
+// per-instance data streamed through a ring buffer.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_BATCH_H
+#define QGL_BATCH_H
+
+#include "qgl/common.hpp"
+#include "qgl/shader.hpp"
+#include "qgl/ringbuffer.hpp"
+#include "qgl/state.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+
+using namespace std;
+
+
+/* Indexed geometry: a vertex array with an element buffer, and the range of
+ * indices to draw from it. */
+struct QGlMesh {
+    GLuint   vao         = 0;
+    GLenum   mode        = GL_TRIANGLES;
+    GLsizei  count       = 0;                   // Number of indices
+    GLenum   indexType   = GL_UNSIGNED_INT;
+    GLintptr indexOffset = 0;                   // In bytes, within the element buffer
+    GLint    baseVertex  = 0;
+};
+
+
+/* Per-instance vertex attribute, read from the instance data of each draw
+ * (e.g. a mat4 takes 4 attributes of 4 floats, 16 bytes apart). */
+struct QGlInstanceAttribute {
+    GLuint    location;
+    GLint     components;
+    GLenum    type       = GL_FLOAT;
+    GLuint    offset     = 0;                   // Within the instance data
+    GLboolean normalized = GL_FALSE;
+    bool      integer    = false;               // Read as int/uint in the shader (glVertexAttribIPointer)
+};
+
+
+/* Counters of the last flush. */
+struct QGlBatchStats {
+    uint32_t commands  = 0;     // Submitted draws (instances)
+    uint32_t draws     = 0;     // Instanced draw calls issued
+    uint32_t programs  = 0;     // Program changes
+    uint32_t materials = 0;     // Material changes
+    uint32_t dropped   = 0;     // Instances that did not fit in the streaming buffer
+};
+
+
+/* Usage, once per frame:
+ *
+ *     for (Object& object : objects)
+ *         batch.submit(program, object.mesh, &object.model, object.material);
+ *     batch.flush();
+ *
+ * Instead of one draw per object, one instanced draw is issued per unique
+ * (program, mesh, material), so the cost scales with the number of unique
+ * states rather than with the number of objects. The instance attributes are
+ * bound to the vertex array of each mesh, pointing to the streaming buffer.
+ *
+ * Materials are opaque numbers (e.g. indices into your own table): before
+ * drawing with a different one, the material callback is called to bind it.
+ * Only their low 24 bits are sorted on, so larger ones batch less well.
+ * Requires OpenGL 4.4 (see QGlRingBuffer), and instance data laid out as
+ * given to withInstanceLayout(). */
+class QGlBatch {
+private:
+    struct QGlDrawCommand {
+        uint64_t key;           // Program | mesh | material, in sorting order
+        uint32_t program;
+        uint32_t mesh;          // Index in meshes
+        uint32_t material;
+        uint32_t data;          // Offset of the instance data in staging
+
+        /* Keys are equal for distinct states beyond the width of their fields */
+        bool sameDraw(const QGlDrawCommand& other) const {
+            return key == other.key && program == other.program && mesh == other.mesh && material == other.material;
+        }
+    };
+
+    GLsizei                      stride = 0;
+    vector<QGlInstanceAttribute> layout;
+    QGlRingBuffer                instances;
+
+    vector<QGlDrawCommand>         commands;
+    vector<QGlDrawCommand>         scratch;     // For the radix sort
+    vector<uint8_t>                staging;     // Instance data, in submission order
+    vector<QGlMesh>                meshes;      // Of the commands, numbered in submission order
+    unordered_map<uint64_t, uint32_t> meshIndices;  // Hash of a mesh -> index in meshes
+
+    QGlBatchStats stats;
+
+    uint32_t meshIndex(const QGlMesh&);
+    void     sort();
+    void     bindInstances(GLintptr);
+
+public:
+    function<void(uint32_t)> applyMaterial = [](uint32_t){};   // Default: no materials
+
+    QGlBatch& withInstanceLayout(GLsizei, const vector<QGlInstanceAttribute>&);
+
+    bool create(uint32_t, uint32_t = QGlRingBuffer::DEFAULT_REGIONS);
+    void release();
+
+    void submit(QGlShader&, const QGlMesh&, const void*, uint32_t = 0);
+    void flush();
+    void clear();
+
+    size_t        size()     { return this->commands.size(); }
+    QGlBatchStats getStats() { return this->stats; }
+};
+
+#endif
@@ -20,6 +20,7 @@
 #define CAMERA_H
 
 #include "qgl/common.hpp"
+#include "qgl/frustum.hpp"
 #include <vector>
 
 /* Defines several possible options for camera movement.
@@ -38,10 +39,15 @@ const float PITCH       =   0.0f;
 const float SPEED       =   2.5f;
 const float SENSITIVITY =   0.1f;
 const float ZOOM        =  45.0f;
+const float ASPECT      = 16.0f / 9.0f;
+const float NEAR_PLANE  =   0.1f;
+const float FAR_PLANE   = 100.0f;
 
 
 /* An abstract camera class that processes input and calculates the corresponding
- * Euler Angles, Vectors and Matrices for use in OpenGL. */
+ * Euler Angles, Vectors and Matrices for use in OpenGL.
+ * Mouse movements only accumulate the angles: the vectors are recalculated
+ * once, when next needed, and the matrices only when their inputs changed. */
 class QGlCamera {
 private:
     // QGlCamera Attributes
@@ -60,9 +66,26 @@ private:
     float mouseSensitivity;
     float zoom;
 
+    // Projection: zoom is the vertical field of view, in degrees
+    float aspectRatio;
+    float nearPlane;
+    float farPlane;
+
+    // Cached matrices, recomputed on demand after their inputs change
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    bool      anglesChanged         = false;    // The vectors are stale (mouse movement since the last update)
+    bool      viewChanged           = true;
+    bool      projectionChanged     = true;
+    bool      viewProjectionChanged = true;
+
     // Calculates the front vector from the QGlCamera's (updated) Euler Angles
     void updateCameraVectors();
 
+    // Applies the pending angle changes, once for all the mouse movements since the last call
+    void applyAngles();
+
 public:
     // Constructor with vectors
     QGlCamera(glm::vec3 = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 = glm::vec3(0.0f, 1.0f, 0.0f), float = YAW, float = PITCH);
@@ -71,7 +94,16 @@ public:
     QGlCamera(float, float, float, float, float, float, float, float);
 
     // Returns the view matrix calculated using Euler Angles and the LookAt Matrix
-    glm::mat4 getViewMatrix();
+    const glm::mat4& getViewMatrix();
+
+    // Returns the perspective projection matrix, with the zoom as field of view
+    const glm::mat4& getProjectionMatrix();
+
+    // Returns the projection matrix times the view matrix
+    const glm::mat4& getViewProjectionMatrix();
+
+    // Returns the frustum of the view and projection, to test bounding volumes in world space
+    QGlFrustum getFrustum();
 
     // Processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void processKeyboard(Camera_Movement, float);
@@ -92,6 +124,9 @@ public:
     QGlCamera& withMovementSpeed(float);
     QGlCamera& withMouseSensitivity(float);
     QGlCamera& withZoom(float);
+    QGlCamera& withAspectRatio(float);
+    QGlCamera& withNearPlane(float);
+    QGlCamera& withFarPlane(float);
 
     glm::vec3 getPosition();
     glm::vec3 getFront();
@@ -103,6 +138,48 @@ public:
     float     getMovementSpeed();
     float     getMouseSensitivity();
     float     getZoom();
+    float     getAspectRatio();
+    float     getNearPlane();
+    float     getFarPlane();
+};
+
+
+/* Many cameras updated together (shadow cascades, cube map faces, split
+ * screens...). Their parameters are kept as a structure of arrays, to be
+ * changed directly, and update() calculates the matrices of all of them in a
+ * single pass, 4 cameras at a time where SSE is available. As in QGlCamera,
+ * angles are in degrees and the field of view is vertical; all the cameras
+ * share the same world up vector. */
+class QGlCameraArray {
+private:
+    glm::vec3 worldUp = glm::vec3(0.0f, 1.0f, 0.0f);
+
+    // Per camera, calculated by update(): sines and cosines, and the non-zero projection terms
+    vector<float> sinYaw, cosYaw, sinPitch, cosPitch;
+    vector<float> projX, projY, projZ, projW;
+
+    vector<glm::mat4> views;
+    vector<glm::mat4> projections;
+    vector<glm::mat4> viewProjections;
+
+public:
+    vector<float> x, y, z;                  // Position
+    vector<float> yaw, pitch;
+    vector<float> fov, aspectRatio, nearPlane, farPlane;
+
+    size_t add(glm::vec3, float = YAW, float = PITCH, float = ZOOM, float = ASPECT, float = NEAR_PLANE, float = FAR_PLANE);
+    size_t add(QGlCamera&);
+    void   clear();
+
+    QGlCameraArray& withWorldUp(glm::vec3 worldUp) { this->worldUp = worldUp; return *this; }
+
+    void update();
+
+    const glm::mat4& getViewMatrix(size_t i)           { return this->views[i]; }
+    const glm::mat4& getProjectionMatrix(size_t i)     { return this->projections[i]; }
+    const glm::mat4& getViewProjectionMatrix(size_t i) { return this->viewProjections[i]; }
+    QGlFrustum       getFrustum(size_t i)              { return QGlFrustum(this->viewProjections[i]); }
+    size_t           size() const                      { return this->x.size(); }
 };
 
 #endif
\ No newline at end of file
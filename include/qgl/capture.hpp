@@ -0,0 +1,142 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    capture.hpp
+//
+// DESCRIPTION:
+// -----------
+// Frame capture: asynchronous readback of the framebuffer through pixel pack
+// buffers, and a writer thread saving the frames as PNG or raw files, or
+// streaming them to the standard input of a command.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_CAPTURE_H
+#define QGL_CAPTURE_H
+
+#include "qgl/common.hpp"
+#include "qgl/texture.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <filesystem>
+#include <cstdio>
+#include <cstdint>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+enum class QGlCaptureFormat {
+    PNG,            // A file per frame (RGBA, uncompressed)
+    Raw,            // A file per frame: RGBA rows, top to bottom
+    Pipe            // Raw frames written to the standard input of a command
+};
+
+
+struct QGlCaptureStats {
+    uint64_t captured = 0;          // Frames read back
+    uint64_t written  = 0;
+    uint64_t dropped  = 0;          // Skipped: the GPU or the writer fell behind
+};
+
+
+/* Usage:
+ *
+ *     cls.withCapture().start("frames/%06d.png");
+ *     cls.withCapture().start("ffmpeg -f rawvideo -pixel_format rgba -video_size 1280x720 -i - out.mp4",
+ *                             QGlCaptureFormat::Pipe);
+ *     ...
+ *     cls.withCapture().stop();
+ *
+ * The scene reads its framebuffer back after each refresh. Each readback goes
+ * to one of a ring of pixel pack buffers, and is mapped on a later frame,
+ * once its fence shows the GPU has finished it; the frame is then copied out
+ * and queued for the writer thread. Rendering never waits for the GPU or for
+ * the disk: when all buffers are in flight, or the queue of the writer is
+ * full, frames are dropped instead (see getStats()).
+ *
+ * File names are patterns with a %d conversion (e.g. %06d) for the number of
+ * the frame. Frames keep the size they had when read back. If the command
+ * closes its input, capture stops on the next frame (see getError()). */
+class QGlCapture {
+private:
+    struct QGlCaptureSlot {
+        GLuint     buffer = 0;
+        GLsizeiptr size   = 0;
+        GLsync     fence  = nullptr;
+        int        width  = 0;
+        int        height = 0;
+    };
+
+    struct QGlCaptureFrame {
+        vector<uint8_t> pixels;
+        int             width, height;
+        uint64_t        index;
+    };
+
+    static const uint32_t DEFAULT_DEPTH = 3;
+    static const size_t   DEFAULT_QUEUE = 8;
+
+    uint32_t               depth      = DEFAULT_DEPTH;
+    size_t                 queueLimit = DEFAULT_QUEUE;
+    vector<QGlCaptureSlot> slots;
+    uint32_t               oldest     = 0;      // Slot of the oldest readback in flight
+    uint32_t               inFlight   = 0;
+
+    QGlCaptureFormat format    = QGlCaptureFormat::PNG;
+    string           target;
+    FILE*            pipe      = nullptr;
+    uint64_t         frames    = 0;
+    bool             capturing = false;
+    QGlStagingPool   staging;
+
+    thread                  writer;
+    mutex                   lock;
+    condition_variable      wakeup;
+    deque<QGlCaptureFrame>  queue;
+    bool                    stopping = false;
+    atomic<bool>            failed   = false;   // The pipe was closed: capture stops
+    QGlCaptureStats         stats;
+    string                  error;
+
+    void collect(bool);
+    void write();
+    bool writeFrame(const QGlCaptureFrame&, string&);
+    void stopWriter();
+
+public:
+    QGlCapture() = default;
+    ~QGlCapture();
+    QGlCapture(const QGlCapture&) = delete;
+    QGlCapture& operator=(const QGlCapture&) = delete;
+
+    QGlCapture& withDepth(uint32_t);
+    QGlCapture& withQueue(size_t);
+
+    bool start(const string&, QGlCaptureFormat = QGlCaptureFormat::PNG);
+    void readback(GLuint, int, int);
+    void stop();
+
+    bool            isCapturing() { return this->capturing; }
+    QGlCaptureStats getStats();
+    string          getError();
+
+    static bool writePNG(const fs::path&, const uint8_t*, int, int, string&);
+};
+
+#endif
@@ -15,6 +15,11 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#ifdef QGL_EGL
+    #include <EGL/egl.h>
+    #include <EGL/eglext.h>
+#endif
+
 #ifdef QGL_FREETYPE
     #include <ft2build.h>
     #include FT_FREETYPE_H
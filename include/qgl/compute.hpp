@@ -0,0 +1,145 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    compute.hpp
+//
+// DESCRIPTION:
+// -----------
+// Compute shader utilities: storage buffer and image bindings, dispatches
+// sized from the work group size of the program, and GPU-driven frustum
+// culling that writes indirect draw commands.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_COMPUTE_H
+#define QGL_COMPUTE_H
+
+#include "qgl/common.hpp"
+#include "qgl/shader.hpp"
+#include "qgl/camera.hpp"
+#include "qgl/batch.hpp"
+#include "qgl/state.hpp"
+
+#include <array>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+using namespace std;
+
+
+/* Dispatches a compute program (a QGlShader built with a single compute
+ * shader). Sizes are given in invocations, e.g. one per element: they are
+ * rounded up to whole work groups of the size declared by the program
+ * (layout(local_size_x = ...) in), so the shader must skip the extra ones.
+ *
+ * Every dispatch ends with a memory barrier, by default for storage buffers
+ * read by later shaders: pass the bits matching how the results are used next
+ * (e.g. GL_COMMAND_BARRIER_BIT for indirect commands), or 0 for none. */
+class QGlCompute {
+private:
+    QGlShader*       shader  = nullptr;
+    GLuint           program = 0;       // Of the work group size below: programs change on reload
+    array<GLuint, 3> groupSize = { 1, 1, 1 };
+
+    void updateGroupSize();
+
+public:
+    QGlCompute() = default;
+    QGlCompute(QGlShader& shader) { this->withShader(shader); }
+
+    QGlCompute& withShader(QGlShader&);
+
+    QGlCompute& bindStorage(GLuint, GLuint);
+    QGlCompute& bindStorage(GLuint, GLuint, GLintptr, GLsizeiptr);
+    QGlCompute& bindImage(GLuint, GLuint, GLenum, GLenum, GLint = 0);
+
+    void dispatch(GLuint, GLuint = 1, GLuint = 1, GLbitfield = GL_SHADER_STORAGE_BARRIER_BIT);
+    void dispatchGroups(GLuint, GLuint = 1, GLuint = 1, GLbitfield = GL_SHADER_STORAGE_BARRIER_BIT);
+    void dispatchIndirect(GLuint, GLintptr = 0, GLbitfield = GL_SHADER_STORAGE_BARRIER_BIT);
+
+    array<GLuint, 3> getGroupSize();
+};
+
+
+/* Layout of the commands read by glMultiDrawElementsIndirect(). */
+struct QGlDrawElementsCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+
+/* Frustum culling of instances on the GPU, with a built-in compute kernel:
+ * each instance has a bounding sphere and the mesh it is drawn with. The
+ * kernel counts the visible instances of each mesh in an indirect command,
+ * and lists their indices, so that draw() draws them all without the CPU
+ * ever reading the results back:
+ *
+ *     culling.setMeshes(meshes);                   // Same vertex array and index type
+ *     culling.setInstances(spheres, meshOfEach);
+ *     ...
+ *     culling.cull(camera);                        // Every frame
+ *     culling.draw();
+ *
+ * In the vertex shader, the index of the instance being drawn (to fetch its
+ * data, e.g. from a storage buffer) is the attribute added to the vertex
+ * array with bindVisibleIndices(). Culling uses the storage buffer binding
+ * points 0 to 3. Requires OpenGL 4.3. */
+class QGlGpuCulling {
+private:
+    static const GLuint GROUP_SIZE = 256;
+
+    GLuint program        = 0;
+    GLuint bounds         = 0;      // vec4 per instance: center, radius
+    GLuint meshOf         = 0;      // uint per instance: index of its mesh
+    GLuint templates      = 0;      // Commands with no instances, copied to commands before culling
+    GLuint commands       = 0;      // The indirect commands
+    GLuint visible        = 0;      // Visible instances, grouped by mesh (at the base instance of its command)
+    GLint  planesLocation = -1;
+    GLint  countLocation  = -1;
+
+    vector<QGlMesh>  meshes;
+    vector<uint32_t> instancesOf;   // Per mesh
+    uint32_t         instanceCount = 0;
+    string           error;
+
+    bool compileKernel();
+    void uploadTemplates();
+
+public:
+    QGlGpuCulling() = default;
+    QGlGpuCulling(const QGlGpuCulling&) = delete;
+    QGlGpuCulling& operator=(const QGlGpuCulling&) = delete;
+
+    bool create();
+    void release();
+
+    bool setMeshes(const vector<QGlMesh>&);
+    bool setInstances(const vector<glm::vec4>&, const vector<uint32_t>& = {});
+    void updateBounds(const glm::vec4*, uint32_t, uint32_t = 0);
+
+    void cull(const glm::mat4&);
+    void cull(QGlCamera&);
+    void draw();
+    void bindVisibleIndices(GLuint);
+
+    uint32_t getVisibleCount();
+
+    GLuint getCommandBuffer() { return this->commands; }
+    GLuint getVisibleBuffer() { return this->visible;  }
+    string getError()         { return this->error;    }
+};
+
+#endif
@@ -0,0 +1,92 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    events.hpp
+//
+// DESCRIPTION:
+// -----------
+// Typed window events and the fixed-capacity queue that holds them between
+// the GLFW callbacks and the once-per-frame dispatch by QGlScene.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_EVENTS_H
+#define QGL_EVENTS_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+
+enum class QGlEventType : uint8_t {
+    FramebufferSize,
+    MouseButton,
+    CursorPosition,
+    Scroll,
+    Key,
+    Count
+};
+
+
+struct QGlEvent {
+    QGlEventType type;
+    union {
+        struct { int width, height; }                  framebuffer;
+        struct { int button, action, mods; }           mouseButton;
+        struct { double x, y; }                        cursor;
+        struct { double xoffset, yoffset; }            scroll;
+        struct { int key, scancode, action, mods; }    key;
+    };
+};
+
+
+/* Ring buffer allocated once: pushing and draining never allocate.
+ * Consecutive cursor positions are merged, since only the last one matters. */
+template <size_t N>
+class QGlEventQueue {
+private:
+    std::array<QGlEvent, N> events;
+    size_t head    = 0;
+    size_t count   = 0;
+    size_t dropped = 0;
+
+public:
+    void push(const QGlEvent& event) {
+        if (event.type == QGlEventType::CursorPosition && this->count > 0) {
+            QGlEvent& last = this->events[(this->head + this->count - 1) % N];
+            if (last.type == QGlEventType::CursorPosition) {
+                last = event;
+                return;
+            }
+        }
+        if (this->count == N) {
+            this->dropped++;
+            return;
+        }
+        this->events[(this->head + this->count) % N] = event;
+        this->count++;
+    }
+
+    bool pop(QGlEvent& event) {
+        if (this->count == 0)
+            return false;
+        event = this->events[this->head];
+        this->head = (this->head + 1) % N;
+        this->count--;
+        return true;
+    }
+
+    size_t size()       { return this->count; }
+    size_t getDropped() { return this->dropped; }
+};
+
+#endif
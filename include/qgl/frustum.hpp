@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    frustum.hpp
+//
+// DESCRIPTION:
+// -----------
+// View frustum planes, and visibility tests of bounding spheres and boxes,
+// one at a time or in batches (vectorized with SSE/AVX where available).
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_FRUSTUM_H
+#define QGL_FRUSTUM_H
+
+#include "qgl/common.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+
+/* Bounding spheres as a structure of arrays (all of the same size), so that
+ * batch tests load several of them at once. */
+struct QGlSpheres {
+    vector<float> x, y, z, radius;
+
+    void add(glm::vec3 center, float r) {
+        x.push_back(center.x); y.push_back(center.y); z.push_back(center.z); radius.push_back(r);
+    }
+    void   reserve(size_t n) { x.reserve(n); y.reserve(n); z.reserve(n); radius.reserve(n); }
+    void   clear()           { x.clear(); y.clear(); z.clear(); radius.clear(); }
+    size_t size() const      { return x.size(); }
+};
+
+
+/* Axis-aligned bounding boxes as a structure of arrays (all of the same size). */
+struct QGlBoxes {
+    vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+    void add(glm::vec3 lo, glm::vec3 hi) {
+        minX.push_back(lo.x); minY.push_back(lo.y); minZ.push_back(lo.z);
+        maxX.push_back(hi.x); maxY.push_back(hi.y); maxZ.push_back(hi.z);
+    }
+    void   reserve(size_t n) { for (vector<float>* v : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) v->reserve(n); }
+    void   clear()           { for (vector<float>* v : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) v->clear(); }
+    size_t size() const      { return minX.size(); }
+};
+
+
+/* The six planes of a view frustum (left, right, bottom, top, near, far), as
+ * (normal, distance), with unit normals pointing inside. Extracted from a
+ * view-projection matrix, the volumes are tested in world space (from a
+ * projection matrix alone, in view space).
+ *
+ * Tests are conservative: a volume is only culled if it is entirely outside
+ * one of the planes, so some volumes near the corners pass while invisible. */
+class QGlFrustum {
+private:
+    glm::vec4 planes[6];
+
+public:
+    QGlFrustum() = default;
+    QGlFrustum(const glm::mat4&);
+
+    bool testSphere(glm::vec3, float) const;
+    bool testBox(glm::vec3, glm::vec3) const;
+
+    size_t cullSpheres(const QGlSpheres&, vector<uint32_t>&) const;
+    size_t cullBoxes(const QGlBoxes&, vector<uint32_t>&) const;
+
+    const glm::vec4& getPlane(int i) const { return this->planes[i]; }
+    const glm::vec4* getPlanes() const     { return this->planes; }
+
+    static const char* getInstructionSet();
+};
+
+#endif
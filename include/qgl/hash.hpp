@@ -0,0 +1,46 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    hash.hpp
+//
+// DESCRIPTION:
+// -----------
+// Small, dependency-free hashing helpers used to key caches by content.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_HASH_H
+#define QGL_HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+
+const uint64_t QGL_HASH_SEED = 0xcbf29ce484222325ULL;
+
+
+/* 64-bit FNV-1a. Pass a previous result as seed to hash several chunks as one. */
+inline uint64_t qglHashBytes(const void* data, size_t size, uint64_t hash = QGL_HASH_SEED) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+inline uint64_t qglHash(std::string_view data, uint64_t hash = QGL_HASH_SEED) {
+    return qglHashBytes(data.data(), data.size(), hash);
+}
+
+#endif
@@ -0,0 +1,88 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    input.hpp
+//
+// DESCRIPTION:
+// -----------
+// Keyboard and mouse button state, updated from window events, with
+// constant-time queries and a table binding actions to keys.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_INPUT_H
+#define QGL_INPUT_H
+
+#include "qgl/common.hpp"
+
+#include <bitset>
+#include <array>
+#include <vector>
+#include <cstdint>
+
+
+/* Actions bound by default. Number your own actions from INPUT_USER onwards. */
+enum QGlInputAction {
+    INPUT_EXIT,
+    INPUT_FORWARD,
+    INPUT_BACKWARD,
+    INPUT_LEFT,
+    INPUT_RIGHT,
+    INPUT_USER
+};
+
+
+class QGlInput {
+public:
+    static const unsigned MAX_KEYS_PER_ACTION = 4;
+
+private:
+    typedef std::array<int16_t, MAX_KEYS_PER_ACTION> Binding;     // -1: free slot
+
+    /* Presses and releases are latched until a processInput() step has seen
+     * them, so that none is lost or seen twice, whatever the number of steps
+     * per frame, and a press and release within one frame are both seen */
+    std::bitset<GLFW_KEY_LAST + 1>          keys;
+    std::bitset<GLFW_KEY_LAST + 1>          pressedKeys;
+    std::bitset<GLFW_KEY_LAST + 1>          releasedKeys;
+    std::bitset<GLFW_MOUSE_BUTTON_LAST + 1> buttons;
+    std::bitset<GLFW_MOUSE_BUTTON_LAST + 1> pressedButtons;
+    std::bitset<GLFW_MOUSE_BUTTON_LAST + 1> releasedButtons;
+    std::vector<Binding>                    bindings;
+
+    template <class F> bool anyBound(unsigned, F) const;
+
+public:
+    QGlInput();
+
+    /* Called by QGlScene: consume() after each processInput() step */
+    void consume();
+    void setKey(int, int);
+    void setButton(int, int);
+
+    bool isDown(int key) const;
+    bool wasPressed(int key) const;
+    bool wasReleased(int key) const;
+
+    bool isButtonDown(int button) const;
+    bool wasButtonPressed(int button) const;
+    bool wasButtonReleased(int button) const;
+
+    QGlInput& bind(unsigned, int);
+    QGlInput& unbind(unsigned);
+
+    bool isActionDown(unsigned) const;
+    bool wasActionPressed(unsigned) const;
+    bool wasActionReleased(unsigned) const;
+};
+
+#endif
@@ -0,0 +1,132 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    mesh.hpp
+//
+// DESCRIPTION:
+// -----------
+// Binary mesh format (.qglm): a header, then the interleaved vertices and the
+// indices, ready to be handed to OpenGL as they are. Files are mapped in
+// memory, and uploaded straight from the mapping.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_MESH_H
+#define QGL_MESH_H
+
+#include "qgl/common.hpp"
+#include "qgl/batch.hpp"
+#include "qgl/preprocessor.hpp"
+
+#include <string>
+#include <memory>
+#include <filesystem>
+#include <cstdint>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+/* Vertex attribute, as stored in the file. */
+struct QGlMeshAttribute {
+    uint8_t  location;
+    uint8_t  components;
+    uint8_t  normalized;
+    uint8_t  integer;                   // Read as int/uint in the shader (glVertexAttribIPointer)
+    uint32_t type;                      // GL_FLOAT, GL_UNSIGNED_BYTE...
+    uint32_t offset;                    // Within the vertex
+};
+
+
+/* The file starts with this header, in the byte order of the machine that
+ * wrote it; the vertex and index blocks follow, each aligned to
+ * QGL_MESH_ALIGNMENT bytes from the start of the file. */
+struct QGlMeshHeader {
+    char     magic[4];                  // "QGLM"
+    uint32_t version;
+    uint32_t vertexStride;
+    uint32_t attributeCount;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint32_t indexType;                 // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t mode;                      // GL_TRIANGLES...
+    float    boundsMin[3];
+    float    boundsMax[3];
+    QGlMeshAttribute attributes[8];
+};
+
+static_assert(sizeof(QGlMeshHeader) == 176, "QGlMeshHeader must have no padding");
+
+const uint32_t QGL_MESH_VERSION   = 1;
+const uint64_t QGL_MESH_ALIGNMENT = 256;
+
+
+/* A .qglm file, mapped in memory: its blocks are read where they lie. */
+class QGlMeshFile {
+private:
+    shared_ptr<QGlSourceFile> file;
+    QGlMeshHeader             header {};
+    string                    error;
+
+public:
+    bool open(const fs::path&);
+    void close();
+
+    const QGlMeshHeader& getHeader() const { return this->header; }
+    const void* getVertices() const;
+    const void* getIndices() const;
+    size_t      getVertexBytes() const { return this->header.vertexCount * this->header.vertexStride; }
+    size_t      getIndexBytes() const;
+    string      getError() const { return this->error; }
+
+    static bool write(const fs::path&, QGlMeshHeader, const void*, const void*, string&);
+};
+
+
+/* Usage:
+ *
+ *     QGlStaticMesh model;
+ *     if (!model.load("models/city.qglm"))
+ *         cerr << model.getError() << endl;
+ *     batch.submit(shader, model.getMesh(), &instance);
+ *
+ * The buffers are created from the mapped file: the driver reads the blocks
+ * from the page cache, with no copy, parsing or conversion on the way. */
+class QGlStaticMesh {
+private:
+    GLuint        vao          = 0;
+    GLuint        vertexBuffer = 0;
+    GLuint        indexBuffer  = 0;
+    QGlMeshHeader header {};
+    string        error;
+
+public:
+    QGlStaticMesh() = default;
+    QGlStaticMesh(const QGlStaticMesh&) = delete;
+    QGlStaticMesh& operator=(const QGlStaticMesh&) = delete;
+
+    bool load(const fs::path&);
+    bool upload(const QGlMeshFile&);
+    void release();
+
+    QGlMesh   getMesh() const;
+    GLuint    getVAO() const          { return this->vao; }
+    GLuint    getVertexBuffer() const { return this->vertexBuffer; }
+    GLuint    getIndexBuffer() const  { return this->indexBuffer; }
+    glm::vec3 getBoundsMin() const    { return glm::vec3(this->header.boundsMin[0], this->header.boundsMin[1], this->header.boundsMin[2]); }
+    glm::vec3 getBoundsMax() const    { return glm::vec3(this->header.boundsMax[0], this->header.boundsMax[1], this->header.boundsMax[2]); }
+    string    getError() const        { return this->error; }
+};
+
+#endif
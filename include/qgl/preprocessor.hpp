@@ -0,0 +1,134 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    preprocessor.hpp
+//
+// DESCRIPTION:
+// -----------
+// GLSL source loading: a process-wide cache of memory-mapped source files,
+// and the #include preprocessor built on it.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_PREPROCESSOR_H
+#define QGL_PREPROCESSOR_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+/* Read-only contents of a file, mapped in memory where mmap is available. */
+class QGlSourceFile {
+private:
+    const char* data   = nullptr;
+    size_t      size   = 0;
+    bool        mapped = false;
+    string      buffer;             // Contents, when the file could not be mapped
+
+public:
+    QGlSourceFile() = default;
+    ~QGlSourceFile();
+    QGlSourceFile(const QGlSourceFile&) = delete;
+    QGlSourceFile& operator=(const QGlSourceFile&) = delete;
+
+    static shared_ptr<QGlSourceFile> open(const fs::path&, string&);
+
+    string_view view() const { return string_view(this->data, this->size); }
+};
+
+
+/* Counters of the source cache: reads are files actually loaded from disk. */
+struct QGlSourceCacheStats {
+    uint32_t reads = 0;
+    uint32_t hits  = 0;
+};
+
+
+/* Every source file is read once per process and kept for as long as its
+ * modification time and size do not change. Thread-safe, since sources are
+ * usually read on worker threads. */
+class QGlSourceCache {
+private:
+    struct QGlSourceEntry {
+        fs::file_time_type               mtime;
+        uintmax_t                        size;
+        shared_ptr<const QGlSourceFile>  file;
+    };
+
+    static mutex                                   lock;
+    static unordered_map<string, QGlSourceEntry>   entries;   // Normalized path -> contents
+    static QGlSourceCacheStats                     stats;
+
+public:
+    static shared_ptr<const QGlSourceFile> get(const fs::path&, string&);
+
+    static QGlSourceCacheStats getStats();
+    static void                resetStats();
+    static void                clear();
+};
+
+
+/* Expands #include "file" and #include <file> directives recursively, and
+ * emits #line directives so that compilation errors point to the right line.
+ * GLSL identifies files by number only: the main file is source 0, and every
+ * included file is numbered in order of first inclusion (see getIncludes()).
+ *
+ * Quoted paths are looked up next to the including file first, then in the
+ * root path; bracketed paths only in the root path. Files with a
+ * "#pragma once" directive are included at most once.
+ *
+ * Directives in comments and in #if 0 blocks are ignored. Other conditional
+ * blocks are not evaluated: the includes within them are always expanded.
+ *
+ * Defines given with withDefines() are inserted right after the #version
+ * directive of the main file (which must come first in GLSL), when the
+ * source refers to them. */
+class QGlPreprocessor {
+private:
+    fs::path              rootPath;
+    vector<fs::path>      includes;     // Source string number - 1 -> file
+    vector<string>        stack;        // Files being expanded, to detect cycles
+    vector<string>        defines;
+    bool                  versioned    = false;     // Flag: #version found in the main file
+    size_t                preambleAt   = 0;         // Where to insert the defines in the output
+    uint32_t              preambleLine = 1;
+    unordered_set<string> once;
+    string                error;
+
+    bool     expand(const fs::path&, uint32_t, string&);
+    bool     resolve(string_view, bool, const fs::path&, fs::path&);
+    uint32_t number(const fs::path&);
+    string   preamble(const string&);
+
+    static string key(const fs::path&);
+
+public:
+    QGlPreprocessor(const fs::path& rootPath) : rootPath(rootPath) {}
+
+    QGlPreprocessor& withDefines(const vector<string>& defines) { this->defines = defines; return *this; }
+
+    bool process(const fs::path&, string&);
+
+    const vector<fs::path>& getIncludes() { return this->includes; }
+    const string&           getError()    { return this->error;    }
+};
+
+#endif
@@ -0,0 +1,141 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    profiler.hpp
+//
+// DESCRIPTION:
+// -----------
+// Per-frame CPU and GPU timing instrumentation, with min/avg/p99 aggregates
+// and export to the Chrome trace_event format (chrome://tracing, Perfetto).
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_PROFILER_H
+#define QGL_PROFILER_H
+
+#include "qgl/common.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <mutex>
+#include <filesystem>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+/* Aggregates of a timed scope, in milliseconds, over the last samples. */
+struct QGlTimingStats {
+    float  min  = 0.0f;
+    float  avg  = 0.0f;
+    float  p99  = 0.0f;
+    float  last = 0.0f;
+    size_t samples = 0;
+};
+
+
+class QGlProfiler {
+public:
+    typedef chrono::steady_clock::time_point TimePoint;
+
+    /* Times the enclosing block. Does nothing if the profiler is disabled. */
+    class Scope {
+    private:
+        QGlProfiler* profiler;
+        uint32_t     track;
+        TimePoint    start;
+
+    public:
+        Scope(QGlProfiler*, uint32_t);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+private:
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(string_view str) const { return hash<string_view>{}(str); }
+    };
+
+    struct Track {
+        string        name;
+        vector<float> samples;      // Ring of the last durations (ms)
+        size_t        next = 0;
+        size_t        count = 0;
+    };
+
+    struct TraceEvent {
+        uint32_t track;
+        uint32_t thread;
+        double   start;             // us since the profiler was created
+        double   duration;          // us
+    };
+
+    bool      enabled = false;
+    bool      tracing = false;
+    size_t    window  = 240;        // Samples kept per track
+    size_t    traceCapacity = 1 << 20;
+    TimePoint epoch = chrono::steady_clock::now();
+    TimePoint frameStart;
+
+    vector<Track> tracks;
+    unordered_map<string, uint32_t, StringHash, equal_to<>> trackIndex;
+    vector<TraceEvent> trace;
+    mutex lock;
+
+    /* GPU timer queries: a ring of them in flight, read back in order once
+     * available, so that the usual frames of GPU latency lose no samples */
+    static const uint32_t GPU_QUERIES = 4;
+    GLuint    gpuQueries[GPU_QUERIES] = {};
+    bool      gpuPending[GPU_QUERIES] = {};
+    TimePoint gpuStart[GPU_QUERIES];
+    uint32_t  gpuFrame = 0;
+    bool      gpuEnabled = false;
+
+    static uint32_t threadId();
+    uint32_t track(string_view);
+    void     record(uint32_t, uint32_t, TimePoint, TimePoint);
+    bool     collectGpu(uint32_t);
+
+public:
+    static const uint32_t GPU_THREAD = 0;
+
+    QGlProfiler() = default;
+    QGlProfiler(const QGlProfiler&) = delete;
+    QGlProfiler& operator=(const QGlProfiler&) = delete;
+
+    QGlProfiler& enable(bool = true, bool = true);
+    QGlProfiler& withWindow(size_t);
+    bool         isEnabled() { return this->enabled; }
+
+    Scope scope(string_view);
+    void  record(uint32_t, TimePoint, TimePoint);
+
+    /* Called by QGlScene around each frame; requires a current context if GPU
+     * timing is enabled */
+    void beginFrame();
+    void endFrame();
+
+    QGlTimingStats getStats(string_view);
+    vector<string> getScopes();
+
+    void startTrace(size_t = 1 << 20);
+    void stopTrace();
+    bool dumpTrace(const fs::path&);
+    void release();
+};
+
+#endif
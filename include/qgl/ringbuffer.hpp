@@ -0,0 +1,106 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    ringbuffer.hpp
+//
+// DESCRIPTION:
+// -----------
+// Streaming buffer for data written by the CPU every frame (dynamic vertices,
+// per-draw uniforms...): a single persistently mapped allocation, split in
+// per-frame regions that are only reused once the GPU is done with them.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_RINGBUFFER_H
+#define QGL_RINGBUFFER_H
+
+#include "qgl/common.hpp"
+#include "qgl/state.hpp"
+
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+
+/* Part of the current region of a ring buffer: write to data, and point the
+ * GPU to offset (e.g. as the offset of a vertex attribute or a buffer range). */
+struct QGlRingAllocation {
+    void*      data   = nullptr;
+    GLintptr   offset = 0;
+    GLsizeiptr size   = 0;
+
+    bool valid() const { return data != nullptr; }
+};
+
+
+/* Counters of a ring buffer. */
+struct QGlRingBufferStats {
+    uint64_t   frames    = 0;
+    uint64_t   stalls    = 0;   // Frames that had to wait for the GPU to release their region
+    uint64_t   overflows = 0;   // Allocations refused for lack of space in the region
+    GLsizeiptr peak      = 0;   // Most bytes used by a frame
+};
+
+
+/* Usage, once per frame:
+ *
+ *     ring.beginFrame();                       // Waits only if the GPU is REGIONS frames late
+ *     QGlRingAllocation a = ring.allocate(size);
+ *     memcpy(a.data, vertices, size);
+ *     ... draw from ring.getBuffer() at a.offset ...
+ *     ring.endFrame();                         // After the last draw reading this frame's data
+ *
+ * The mapping is coherent: writes need no flush. Requires OpenGL 4.4 or
+ * GL_ARB_buffer_storage: check isSupported() before creating one. */
+class QGlRingBuffer {
+private:
+    GLuint         buffer    = 0;
+    GLenum         target    = GL_ARRAY_BUFFER;
+    uint8_t*       mapped    = nullptr;
+    GLsizeiptr     capacity  = 0;       // Of each region
+    GLsizeiptr     stride    = 0;       // Between regions (capacity, aligned)
+    GLsizeiptr     alignment = 16;      // Default alignment of allocations
+    GLsizeiptr     head      = 0;       // Used bytes of the current region
+    uint32_t       current   = 0;
+    bool           inFrame   = false;
+    vector<GLsync> fences;              // One per region, set at the end of its frame
+    QGlRingBufferStats stats;
+
+    void waitFence(uint32_t);
+
+public:
+    static const uint32_t DEFAULT_REGIONS = 3;
+
+    QGlRingBuffer() = default;
+    QGlRingBuffer(const QGlRingBuffer&) = delete;
+    QGlRingBuffer& operator=(const QGlRingBuffer&) = delete;
+
+    static bool isSupported();
+
+    bool create(GLsizeiptr, GLenum = GL_ARRAY_BUFFER, uint32_t = DEFAULT_REGIONS);
+    void release();
+
+    void              beginFrame();
+    QGlRingAllocation allocate(GLsizeiptr, GLsizeiptr = 0);
+    void              endFrame();
+
+    void bind();
+    void bindRange(GLuint, const QGlRingAllocation&);
+
+    GLuint             getBuffer()    { return this->buffer;   }
+    GLsizeiptr         getCapacity()  { return this->capacity; }
+    GLsizeiptr         getUsed()      { return this->head;     }
+    QGlRingBufferStats getStats()     { return this->stats;    }
+};
+
+#endif
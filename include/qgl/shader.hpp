@@ -20,6 +20,10 @@
 #define QGL_SHADER_H
 
 #include "qgl/common.hpp"
+#include "qgl/hash.hpp"
+#include "qgl/preprocessor.hpp"
+#include "qgl/uniformbuffer.hpp"
+#include "qgl/state.hpp"
 
 #include <string>
 #include <fstream>
@@ -27,6 +31,9 @@
 #include <iostream>
 #include <unordered_map>
 #include <filesystem>
+#include <vector>
+#include <memory>
+#include <atomic>
 
 
 #define SHADER_VERTEX    0b00000001
@@ -53,10 +60,12 @@ enum QGlShaderProgramType {
 
 
 struct QGlShaderDef {
-    uint16_t type;
-    string   path;
-    string   code;
-    uint32_t id;
+    uint16_t         type = 0;
+    string           path;
+    string           code;
+    uint32_t         id   = 0;
+    uint64_t         hash = 0;      // Of the code, which is released once the program is built
+    vector<fs::path> includes;      // Files included by the source, by source string number - 1
 };
 
 
@@ -68,6 +77,63 @@ struct QGlShaderInfo {
 };
 
 
+/* Resolved location of an uniform variable within a program.
+ * Obtain it once with QGlShader::getUniform() and pass it to the set* methods,
+ * so that updating the uniform never requires a lookup by name. The handle
+ * remembers the link it was resolved against: after the program is rebuilt
+ * (e.g. by a hot reload), the next set* call resolves it again. */
+struct QGlUniform {
+    string           name;
+    mutable GLint    location   = -1;
+    mutable uint32_t generation = 0;    // Of the link it was resolved against
+
+    bool valid() const { return location >= 0; }
+};
+
+
+/* Counters of the on-disk program binary cache. */
+struct QGlShaderCacheStats {
+    uint32_t hits   = 0;
+    uint32_t misses = 0;
+};
+
+
+/* Counters of the stage cache: stages compiled, and stages shared instead. */
+struct QGlStageCacheStats {
+    uint32_t compiled = 0;
+    uint32_t reused   = 0;
+};
+
+
+/* Shader objects shared by the programs linked from the same sources.
+ * A stage is compiled once for every program submitted while it is alive, and
+ * deleted after the last of these programs is linked: submitting many programs
+ * before finishing them (as QGlScene::buildPrograms() does) compiles each
+ * distinct stage only once. Shader objects belong to a context (or a group of
+ * shared contexts), hence there is one cache per scene. */
+class QGlStageCache {
+private:
+    struct QGlStage {
+        GLuint   id;
+        uint32_t users;
+    };
+
+    unordered_map<uint64_t, QGlStage> stages;   // (Type, source hash) -> shader object
+    unordered_map<GLuint, uint64_t>   keys;     // Shader object -> (type, source hash)
+    QGlStageCacheStats                stats;
+
+    static uint64_t key(const QGlShaderDef&);
+
+public:
+    GLuint acquire(const QGlShaderDef&);
+    void   insert(const QGlShaderDef&);
+    void   release(GLuint);
+
+    size_t             size()     { return this->stages.size(); }
+    QGlStageCacheStats getStats() { return this->stats; }
+};
+
+
 class QGlShaderReport {
 private:
     uint16_t error;
@@ -86,18 +152,40 @@ public:
 
 class QGlShader {
 private:
-    unsigned int         id;
+    unsigned int         id = 0;
     QGlShaderInfo        shader;
     QGlShaderReport      report;
-    QGlShaderProgramType type;
+    QGlShaderProgramType type = QGlShaderProgramType::Undefined;
     fs::path             rootPath;
+    vector<string>       defines;       // Inserted after #version in every stage
+    shared_ptr<QGlStageCache> stages;   // Null: stages are never shared
+
+    mutable unordered_map<string, GLint> uniforms;  // Uniform name -> location
+    uint32_t             generation = 0;    // Of the last link: unique across programs
+
+    static atomic<uint32_t> generations;
+
+    static fs::path            binaryCache;     // Empty: cache disabled
+    static QGlShaderCacheStats cacheStats;
+
+    bool                 pending = false;   // Flag: submitted, but not finished
 
     bool readShader(QGlShaderDef&);
-    bool compile(QGlShaderDef&);
-    bool link();
+    void compile(QGlShaderDef&);
+    void link();
+    void deleteShaders();
+    void releaseSources();
+
+    fs::path binaryCachePath();
+    bool     loadBinary();
+    void     storeBinary();
+    void reflectUniforms();
+
+    GLint uniformLocation(const string&) const;
+    GLint uniformLocation(const QGlUniform&) const;
 
     bool checkErrors(QGlShaderDef&);
-    bool checkErrors(uint32_t, uint16_t);
+    bool checkErrors(uint32_t, uint16_t, const string& = "");
 
     static string canonicalPath(fs::path, string);
 
@@ -111,13 +199,30 @@ public:
 
     QGlShader& withShaders(const string, const string, const string = "");
     QGlShader& withShaders(const string);
+    QGlShader& withDefines(const vector<string>&);
+    QGlShader& withStageCache(shared_ptr<QGlStageCache> stages) { this->stages = stages; return *this; }
 
     uint32_t getID() { return this->id; };
     bool     build();
+
+    /* Asynchronous build, in three steps: build() is the same as calling them in a row */
+    bool     readShaders();
+    bool     submit();
+    bool     isReady();
+    bool     finish();
+    void     release();
+    QGlShader clone() const;
+
+    vector<fs::path> getPaths();
     void     use();
+    void     bindUniformBlocks();
 
     QGlShaderDef getShader(uint16_t);
 
+    static void                setBinaryCache(const fs::path);
+    static QGlShaderCacheStats getCacheStats() { return QGlShader::cacheStats; }
+    static void                resetCacheStats() { QGlShader::cacheStats = QGlShaderCacheStats(); }
+
     bool            wasSuccessful()    { return this->report.success(); }
     string          getReport()        { return this->report.what();    }
     QGlShaderReport getReportHandler() { return this->report;           }
@@ -135,6 +240,21 @@ public:
     void setMat3 (const string&, const glm::mat3&) const;
     void setMat4 (const string&, const glm::mat4&) const;
 
+    QGlUniform getUniform(const string&) const;
+
+    void setBool (const QGlUniform&, bool) const;
+    void setInt  (const QGlUniform&, int) const;
+    void setFloat(const QGlUniform&, float) const;
+    void setVec2 (const QGlUniform&, const glm::vec2&) const;
+    void setVec2 (const QGlUniform&, float, float) const;
+    void setVec3 (const QGlUniform&, const glm::vec3&) const;
+    void setVec3 (const QGlUniform&, float, float, float) const;
+    void setVec4 (const QGlUniform&, const glm::vec4&) const;
+    void setVec4 (const QGlUniform&, float, float, float, float) const;
+    void setMat2 (const QGlUniform&, const glm::mat2&) const;
+    void setMat3 (const QGlUniform&, const glm::mat3&) const;
+    void setMat4 (const QGlUniform&, const glm::mat4&) const;
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    simd.hpp
+//
+// DESCRIPTION:
+// -----------
+// Instruction sets available to the vectorized code paths.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_SIMD_H
+#define QGL_SIMD_H
+
+/* SSE2 is part of every x86-64 processor. AVX is not: functions marked with
+ * QGL_TARGET_AVX are compiled for it regardless of the flags, and must only
+ * be called if qglHasAVX(). */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+    #define QGL_SSE
+    #include <immintrin.h>
+#endif
+
+#if defined(QGL_SSE) && defined(__GNUC__)
+    #define QGL_AVX
+    #define QGL_TARGET_AVX __attribute__((target("avx")))
+
+    inline bool qglHasAVX() {
+        static const bool supported = __builtin_cpu_supports("avx");
+        return supported;
+    }
+#endif
+
+#endif
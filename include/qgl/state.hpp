@@ -0,0 +1,133 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    state.hpp
+//
+// DESCRIPTION:
+// -----------
+// Shadow copy of the OpenGL state of a context, so that binding what is
+// already bound (or enabling what is already enabled) never reaches the driver.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_STATE_H
+#define QGL_STATE_H
+
+#include "qgl/common.hpp"
+
+#include <array>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+
+using namespace std;
+
+
+/* Counters of the state changes asked to a QGlState. */
+struct QGlStateStats {
+    uint64_t issued  = 0;       // Reached the driver
+    uint64_t skipped = 0;       // Redundant: the state was already set
+};
+
+
+/* The state of one context. Each scene owns the state of its context, which
+ * becomes current along with it, on the thread that makes it current:
+ * QGlState::current() always refers to the context current on the caller's
+ * thread (or to a per-thread default state for contexts created elsewhere).
+ *
+ * Every value starts unknown, so the first request is always issued. State
+ * changed with direct OpenGL calls is not seen: call invalidate() afterwards.
+ * Objects deleted while bound must be forgotten (see forget*()), since
+ * OpenGL unbinds them and their names may be reused. Programs, buffers and
+ * textures may be shared with other contexts, which still have them bound:
+ * every forget*() of those bumps a process-wide count of deletions, and the
+ * states that have not seen it yet forget all their bindings of such objects
+ * on their next request. */
+class QGlState {
+private:
+    static const GLuint UNKNOWN = ~0u;
+    static const int    CAPS    = 3;        // Capabilities tracked: blend, depth test, face culling
+
+    struct QGlTextureBinding {
+        GLenum target = 0;
+        GLuint id     = UNKNOWN;
+    };
+
+    GLuint program       = UNKNOWN;
+    GLuint vertexArray   = UNKNOWN;
+    GLuint arrayBuffer   = UNKNOWN;
+    GLuint elementBuffer = UNKNOWN;     // Part of the vertex array state
+    GLuint uniformBuffer = UNKNOWN;
+    GLuint storageBuffer = UNKNOWN;
+    unordered_map<uint64_t, GLuint> indexedBuffers;     // (Target, index) -> buffer
+
+    GLenum activeUnit = 0;              // 0: unknown, else GL_TEXTURE0 + unit
+    array<QGlTextureBinding, 32> textures;
+
+    array<int8_t, CAPS> enabled;        // -1: unknown
+    GLenum blendSrc  = 0, blendDst = 0;
+    GLenum depthFunc = 0;
+    int8_t depthMask = -1;
+    GLenum cullFace  = 0;
+    array<GLint, 4> viewport;
+
+    bool parallelCompile = false;       // GL_KHR_parallel_shader_compile enabled (kept by invalidate())
+
+    static atomic<uint64_t> deletions;  // Shareable objects forgotten by any state
+    uint64_t seen = 0;                  // Deletions this state has accounted for
+
+    QGlStateStats stats;
+
+    bool  changed(bool);
+    void  sync();
+    void  deleted();
+    void  forgetShared();
+    GLuint* bufferBinding(GLenum);
+    static int capability(GLenum);
+
+public:
+    QGlState() { this->invalidate(); }
+
+    static QGlState& current();
+    static void      makeCurrent(QGlState*);
+
+    void useProgram(GLuint);
+    void bindVertexArray(GLuint);
+    void bindBuffer(GLenum, GLuint);
+    void bindBufferBase(GLenum, GLuint, GLuint);
+    void bindBufferRange(GLenum, GLuint, GLuint, GLintptr, GLsizeiptr);
+    void bindTexture(GLuint, GLenum, GLuint);
+
+    void enable(GLenum);
+    void disable(GLenum);
+    void setEnabled(GLenum, bool);
+    void blendFunc(GLenum, GLenum);
+    void setDepthFunc(GLenum);
+    void setDepthMask(bool);
+    void setCullFace(GLenum);
+    void setViewport(GLint, GLint, GLsizei, GLsizei);
+
+    void forgetProgram(GLuint);
+    void forgetVertexArray(GLuint);
+    void forgetBuffer(GLuint);
+    void forgetTexture(GLuint);
+    void invalidate();
+
+    void setParallelCompile(bool enabled) { this->parallelCompile = enabled; }
+    bool hasParallelCompile()             { return this->parallelCompile; }
+
+    GLuint        getProgram()     { return this->program; }
+    QGlStateStats getStats()       { return this->stats; }
+    void          resetStats()     { this->stats = QGlStateStats(); }
+};
+
+#endif
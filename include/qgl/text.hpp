@@ -0,0 +1,185 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    text.hpp
+//
+// DESCRIPTION:
+// -----------
+// Text rendering with FreeType (requires QGL_FREETYPE): glyphs rasterized on
+// demand into atlas pages packed with a skyline, and strings drawn as quads
+// streamed through one buffer, with one draw per atlas page.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_TEXT_H
+#define QGL_TEXT_H
+
+#ifdef QGL_FREETYPE
+
+#include "qgl/common.hpp"
+#include "qgl/ringbuffer.hpp"
+#include "qgl/state.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+/* Packs rectangles in a fixed area, keeping the top edge of what is packed
+ * (the skyline) as segments: each rectangle goes where it rests lowest, so
+ * glyphs of mixed heights waste less space than on shelves. */
+class QGlSkyline {
+private:
+    struct QGlSkylineNode {
+        int x, y, width;
+    };
+
+    int width  = 0;
+    int height = 0;
+    vector<QGlSkylineNode> nodes;
+
+    int fit(size_t, int, int) const;
+
+public:
+    QGlSkyline() = default;
+    QGlSkyline(int width, int height) { this->reset(width, height); }
+
+    void reset(int, int);
+    bool pack(int, int, int&, int&);
+};
+
+
+/* A glyph rasterized in an atlas page, with its metrics in pixels. */
+struct QGlGlyph {
+    uint16_t page    = 0;
+    uint16_t x       = 0, y = 0;            // In the page
+    uint16_t width   = 0, height = 0;       // 0: nothing to draw (e.g. a space)
+    int16_t  left    = 0;                   // From the pen to the left of the bitmap
+    int16_t  top     = 0;                   // From the baseline up to its top
+    float    advance = 0.0f;
+};
+
+
+/* Flat hash table from code points to glyphs: open addressing with linear
+ * probing, so a lookup touches one or two cache lines. */
+class QGlGlyphTable {
+private:
+    static constexpr uint32_t EMPTY = ~0u;
+
+    vector<uint32_t> keys;
+    vector<QGlGlyph> glyphs;
+    size_t           count = 0;
+
+    size_t slot(uint32_t) const;
+
+public:
+    const QGlGlyph* find(uint32_t) const;
+    void            insert(uint32_t, const QGlGlyph&);
+    size_t          size() const { return this->count; }
+};
+
+
+struct QGlTextStats {
+    uint32_t glyphs  = 0;       // Quads drawn by the last flush
+    uint32_t dropped = 0;       // Quads beyond the capacity of the stream, not drawn
+    uint32_t draws   = 0;
+    uint32_t pages   = 0;       // Atlas pages in use
+    uint32_t cached  = 0;       // Glyphs rasterized so far
+};
+
+
+/* Usage:
+ *
+ *     QGlText text;
+ *     text.create();
+ *     int mono = text.addFont("fonts/mono.ttf", 16);
+ *     ...
+ *     text.print(mono, glm::vec2(8, 8), "FPS: " + to_string(fps));
+ *     text.flush(width, height);       // Once per frame, after the scene
+ *
+ * Positions are in pixels, from the top-left corner of the viewport, to the
+ * top-left corner of the text; strings are UTF-8, and '\n' starts a line.
+ * Glyphs are rasterized the first time they are used, so every call is made
+ * on the thread of the context. flush() draws with blending, and without
+ * depth testing or face culling, leaving the state so. */
+class QGlText {
+private:
+    struct QGlTextQuad {                    // Instance data: one per glyph
+        float    x0, y0, x1, y1;            // Pixels
+        uint16_t u0, v0, u1, v1;            // Normalized
+        uint32_t color;                     // RGBA8
+    };
+
+    struct QGlAtlasPage {
+        GLuint              texture = 0;
+        QGlSkyline          packer;
+        vector<QGlTextQuad> quads;          // Printed since the last flush
+    };
+
+    struct QGlFontFace {
+        FT_Face       face = nullptr;
+        QGlGlyphTable glyphs;
+        float         ascender   = 0.0f;
+        float         lineHeight = 0.0f;
+    };
+
+    static const int DEFAULT_PAGE_SIZE = 1024;
+    static const uint32_t DEFAULT_CAPACITY = 16384;
+
+    FT_Library          library  = nullptr;
+    vector<QGlFontFace> fonts;
+    vector<QGlAtlasPage> pages;
+    int                 pageSize = DEFAULT_PAGE_SIZE;
+
+    GLuint        program = 0;
+    GLuint        vao     = 0;
+    GLint         viewportLocation = -1;
+    QGlRingBuffer stream;
+
+    QGlTextStats stats;
+    string       error;
+
+    bool     compileProgram();
+    bool     addPage();
+    QGlGlyph glyph(QGlFontFace&, uint32_t);
+
+public:
+    QGlText() = default;
+    QGlText(const QGlText&) = delete;
+    QGlText& operator=(const QGlText&) = delete;
+
+    QGlText& withPageSize(int);
+
+    bool create(uint32_t = DEFAULT_CAPACITY, uint32_t = QGlRingBuffer::DEFAULT_REGIONS);
+    void release();
+
+    int addFont(const fs::path&, int);
+
+    glm::vec2 print(int, glm::vec2, string_view, glm::vec4 = glm::vec4(1.0f));
+    glm::vec2 measure(int, string_view);
+    void      flush(int, int);
+    void      clear();
+
+    float        getLineHeight(int font) { return this->fonts[font].lineHeight; }
+    GLuint       getPage(int page)       { return this->pages[page].texture; }
+    QGlTextStats getStats()              { return this->stats; }
+    string       getError()              { return this->error; }
+};
+
+#endif
+
+#endif
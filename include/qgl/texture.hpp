@@ -0,0 +1,193 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    texture.hpp
+//
+// DESCRIPTION:
+// -----------
+// Asynchronous texture loading: images are decoded by the thread pool, and
+// uploaded through pixel unpack buffers within a budget of bytes per frame,
+// so that loading never stalls rendering.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_TEXTURE_H
+#define QGL_TEXTURE_H
+
+#include "qgl/common.hpp"
+#include "qgl/ringbuffer.hpp"
+#include "qgl/state.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <cstdint>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+enum class QGlTextureStatus {
+    Decoding,       // On the thread pool
+    Uploading,      // Waiting for (or in the middle of) its upload
+    Fenced,         // Uploaded, waiting for the GPU to finish
+    Ready,
+    Failed
+};
+
+
+struct QGlTextureOptions {
+    bool   mipmaps = true;          // Generated on the GPU, unless the file has them
+    bool   srgb    = false;         // Color data (8 bits per channel) in sRGB
+    GLenum wrap    = GL_REPEAT;
+};
+
+
+/* A level of a decoded image, within its staging memory. */
+struct QGlTextureLevel {
+    size_t offset;
+    size_t size;
+    size_t rowStride;               // 0: compressed (uploaded whole)
+    int    width;
+    int    height;
+};
+
+
+/* Shared by the handles of a texture and its loader. Only the status may be
+ * read by other threads: the rest belongs to the thread that set the status. */
+struct QGlTextureData {
+    atomic<QGlTextureStatus> status { QGlTextureStatus::Decoding };
+    fs::path          path;
+    QGlTextureOptions options;
+    string            error;
+
+    GLuint id = 0;
+    int    width = 0, height = 0;
+    GLenum internalFormat = 0, format = 0, type = 0;
+    bool   compressed = false;
+    GLint  alignment  = 1;          // Of the rows in staging memory
+    bool   generateMipmaps = false;
+
+    vector<uint8_t>         pixels;     // Staging memory, returned to the pool once uploaded
+    vector<QGlTextureLevel> levels;
+    size_t  level    = 0;               // Next level to upload,
+    int     row      = 0;               // and its next row
+    GLsync  fence    = nullptr;
+};
+
+
+/* Handle to a texture: copies refer to the same texture. Until it is ready,
+ * getID() is 0 and bind() binds no texture. The texture is only deleted by
+ * release(), on the thread of its context. */
+class QGlTexture {
+private:
+    shared_ptr<QGlTextureData> data;
+
+public:
+    QGlTexture() = default;
+    QGlTexture(shared_ptr<QGlTextureData> data) : data(data) {}
+
+    bool   isReady() const;
+    bool   hasFailed() const;
+    GLuint getID() const;
+    int    getWidth() const;
+    int    getHeight() const;
+    string getError() const;
+
+    void bind(GLuint) const;
+    void release();
+};
+
+
+/* Memory reused between decoded images, so that streaming textures does not
+ * allocate once per image. Thread-safe. */
+class QGlStagingPool {
+private:
+    mutex                   lock;
+    vector<vector<uint8_t>> free;
+    size_t                  pooled = 0;
+    size_t                  limit;
+
+public:
+    QGlStagingPool(size_t limit = 64u << 20) : limit(limit) {}
+
+    vector<uint8_t> acquire(size_t);
+    void            recycle(vector<uint8_t>&&);
+};
+
+
+struct QGlTextureLoaderStats {
+    uint32_t   loaded   = 0;
+    uint32_t   failed   = 0;
+    uint32_t   pending  = 0;        // Decoding or uploading
+    GLsizeiptr uploaded = 0;        // Bytes uploaded by the last update()
+};
+
+
+/* Usage:
+ *
+ *     QGlTexture albedo = loader.load("textures/albedo.png");
+ *     ...
+ *     loader.update();                 // Once per frame, on the thread of the context
+ *     albedo.bind(0);                  // Binds nothing until it is ready
+ *
+ * load() may be called from any thread. Decoding happens on the shared thread
+ * pool, and update() uploads at most the budget of bytes per frame, splitting
+ * large images in bands of rows. A texture becomes ready once the GPU has
+ * finished its upload (and the generation of its mipmaps).
+ *
+ * Built-in formats: KTX (version 1, 2D textures, compressed or not). Other
+ * formats (PNG, JPEG, HDR...) need quickGL built with QGL_STB_IMAGE, and
+ * stb_image.h in the include path (its implementation defined elsewhere). */
+class QGlTextureLoader {
+private:
+    static const GLsizeiptr DEFAULT_BUDGET = 4 << 20;
+
+    GLsizeiptr     budget = DEFAULT_BUDGET;
+    QGlRingBuffer  buffer;              // Pixel unpack buffer, one region per frame
+    bool           created = false;
+    QGlStagingPool staging;
+
+    mutex                              lock;
+    deque<shared_ptr<QGlTextureData>>  decoded;     // Filled by the thread pool
+    deque<shared_ptr<QGlTextureData>>  uploading;
+    vector<shared_ptr<QGlTextureData>> fenced;
+    atomic<uint32_t>                   decoding { 0 };
+    condition_variable                 idle;        // Signaled as decoding ends
+    QGlTextureLoaderStats              stats;
+
+    void decode(shared_ptr<QGlTextureData>);
+    bool allocate(QGlTextureData&);
+    bool upload(QGlTextureData&, GLsizeiptr&);
+    void finish(QGlTextureData&);
+
+public:
+    QGlTextureLoader() = default;
+    ~QGlTextureLoader();
+    QGlTextureLoader(const QGlTextureLoader&) = delete;
+    QGlTextureLoader& operator=(const QGlTextureLoader&) = delete;
+
+    QGlTextureLoader& withBudget(GLsizeiptr);
+
+    QGlTexture load(const fs::path&, QGlTextureOptions = QGlTextureOptions());
+    void       update();
+    void       release();
+
+    QGlTextureLoaderStats getStats();
+};
+
+#endif
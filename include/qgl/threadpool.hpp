@@ -0,0 +1,77 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    threadpool.hpp
+//
+// DESCRIPTION:
+// -----------
+// Minimal worker pool for CPU-side tasks (file reads, decoding...).
+// Workers never touch OpenGL: results are handed back to the thread owning
+// the context through std::future.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_THREADPOOL_H
+#define QGL_THREADPOOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+
+class QGlThreadPool {
+private:
+    std::vector<std::thread>          workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex                        lock;
+    std::condition_variable           wakeup;
+    bool                              stopping = false;
+
+    void work();
+
+public:
+    QGlThreadPool(unsigned = std::thread::hardware_concurrency());
+    ~QGlThreadPool();
+
+    QGlThreadPool(const QGlThreadPool&) = delete;
+    QGlThreadPool& operator=(const QGlThreadPool&) = delete;
+
+    template <class F>
+    std::future<std::invoke_result_t<F>> submit(F&&);
+
+    unsigned size() { return this->workers.size(); }
+
+    // Process-wide pool shared by every quickGL subsystem
+    static QGlThreadPool& shared();
+};
+
+
+template <class F>
+std::future<std::invoke_result_t<F>> QGlThreadPool::submit(F&& func) {
+    using R = std::invoke_result_t<F>;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+    std::future<R> result = task->get_future();
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->tasks.emplace([task]() { (*task)(); });
+    }
+    this->wakeup.notify_one();
+    return result;
+}
+
+#endif
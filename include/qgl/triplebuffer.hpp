@@ -0,0 +1,57 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    triplebuffer.hpp
+//
+// DESCRIPTION:
+// -----------
+// Lock-free triple buffer: one thread publishes values, another always reads
+// the most recent one, and neither ever waits for the other.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_TRIPLEBUFFER_H
+#define QGL_TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+
+template <class T>
+class QGlTripleBuffer {
+private:
+    static const uint8_t INDEX = 0b011;
+    static const uint8_t FRESH = 0b100;    // Middle slot holds an unread value
+
+    T buffers[3];
+    std::atomic<uint8_t> middle { 1 };
+    uint8_t back  = 0;                      // Owned by the writer
+    uint8_t front = 2;                      // Owned by the reader
+
+public:
+    /* Writer side: fill write(), then publish() it */
+    T&   write() { return this->buffers[this->back]; }
+    void publish() {
+        this->back = this->middle.exchange(this->back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    /* Reader side: update() fetches the latest published value, if any, into read() */
+    bool update() {
+        if (!(this->middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        this->front = this->middle.exchange(this->front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    const T& read() const { return this->buffers[this->front]; }
+};
+
+#endif
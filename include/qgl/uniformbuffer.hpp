@@ -0,0 +1,134 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    uniformbuffer.hpp
+//
+// DESCRIPTION:
+// -----------
+// Uniform buffer objects: the layout of an uniform block is reflected from a
+// program, its members are written into a CPU-side copy, and only the changed
+// ranges are uploaded, once per frame, for every program at once.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_UNIFORMBUFFER_H
+#define QGL_UNIFORMBUFFER_H
+
+#include "qgl/common.hpp"
+#include "qgl/state.hpp"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <cstdint>
+
+using namespace std;
+
+
+/* Resolved location of a member within an uniform block.
+ * Obtain it once with QGlUniformBuffer::getMember() and pass it to the set*
+ * methods, so that updating the member never requires a lookup by name. */
+struct QGlBlockMember {
+    GLint offset       = -1;
+    GLint arrayStride  = 0;
+    GLint matrixStride = 0;
+
+    bool valid() const { return offset >= 0; }
+};
+
+
+/* Counters of the uploads of an uniform buffer. */
+struct QGlUniformBufferStats {
+    uint64_t uploads = 0;       // glBufferSubData calls
+    uint64_t bytes   = 0;
+    uint64_t skipped = 0;       // Writes that did not change the contents
+};
+
+
+/* CPU-side copy of an uniform block and the buffer object it is uploaded to.
+ *
+ * The block must be declared with layout(std140), so that every program
+ * agrees on its layout. Each block name is given a fixed binding point for the
+ * whole process: every program linked by quickGL that declares the block is
+ * bound to it, so the buffer serves all of them without any further call.
+ * Binding points are given from 1 up, skipping those other blocks are bound to
+ * with layout(binding = N) in the programs seen so far. */
+class QGlUniformBuffer {
+private:
+    string  name;
+    GLuint  buffer  = 0;
+    GLuint  binding = 0;
+    vector<uint8_t> staging;
+    unordered_map<string, QGlBlockMember> members;
+    vector<pair<uint32_t, uint32_t>>      dirty;    // Changed byte ranges [begin, end), not yet uploaded
+    QGlUniformBufferStats                 stats;
+    string                                error;
+
+    static mutex                          bindingsLock;
+    static unordered_map<string, GLuint>  bindings;     // Block name -> binding point
+    static unordered_set<GLuint>          reserved;     // Explicit binding points of other blocks
+
+    static void reserveBindings(GLuint);
+
+    void write(QGlBlockMember, const void*, size_t);
+    void writeMatrix(QGlBlockMember, const float*, int, int);
+    void markDirty(uint32_t, uint32_t);
+
+public:
+    static const size_t MAX_DIRTY_RANGES = 8;
+
+    QGlUniformBuffer() = default;
+    QGlUniformBuffer(const QGlUniformBuffer&) = delete;
+    QGlUniformBuffer& operator=(const QGlUniformBuffer&) = delete;
+    QGlUniformBuffer(QGlUniformBuffer&&) = default;
+    QGlUniformBuffer& operator=(QGlUniformBuffer&&) = default;
+
+    bool create(GLuint, const string&);
+    void upload();
+    void bind();
+    void release();
+
+    static bool findBinding(const string&, GLuint&);
+    static void bindBlocks(GLuint);
+
+    const string&         getName()    { return this->name;           }
+    GLuint                getBinding() { return this->binding;        }
+    GLuint                getBuffer()  { return this->buffer;         }
+    size_t                getSize()    { return this->staging.size(); }
+    bool                  isDirty()    { return !this->dirty.empty(); }
+    QGlUniformBufferStats getStats()   { return this->stats;          }
+    const string&         getError()   { return this->error;          }
+
+    QGlBlockMember getMember(const string&) const;
+
+    void setBool (const string&, bool);
+    void setInt  (const string&, int);
+    void setFloat(const string&, float);
+    void setVec2 (const string&, const glm::vec2&);
+    void setVec3 (const string&, const glm::vec3&);
+    void setVec4 (const string&, const glm::vec4&);
+    void setMat3 (const string&, const glm::mat3&);
+    void setMat4 (const string&, const glm::mat4&);
+
+    void setBool (QGlBlockMember, bool);
+    void setInt  (QGlBlockMember, int);
+    void setFloat(QGlBlockMember, float);
+    void setVec2 (QGlBlockMember, const glm::vec2&);
+    void setVec3 (QGlBlockMember, const glm::vec3&);
+    void setVec4 (QGlBlockMember, const glm::vec4&);
+    void setMat3 (QGlBlockMember, const glm::mat3&);
+    void setMat4 (QGlBlockMember, const glm::mat4&);
+};
+
+#endif
@@ -0,0 +1,80 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    variants.hpp
+//
+// DESCRIPTION:
+// -----------
+// Permutations of a program that only differ in their #defines, compiled on
+// demand and cached by the bitmask of their defines.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_VARIANTS_H
+#define QGL_VARIANTS_H
+
+#include "qgl/shader.hpp"
+
+#include <future>
+#include <initializer_list>
+
+using namespace std;
+
+
+/* Bit i of a variant mask enables the i-th key given to withKeys(), e.g.
+ * with keys { "SHADOWS", "SKINNING", "LIGHTS 4" }, mask 0b101 compiles the
+ * program with SHADOWS defined and LIGHTS defined as 4.
+ *
+ * No variant is compiled until it is first used. warm() prepares variants
+ * ahead of time instead: their sources are read by a worker thread and, when
+ * the driver supports it, compiled on its own threads, while update() (called
+ * once per frame) finishes the ones that are ready without ever waiting. */
+class QGlShaderVariants {
+private:
+    struct QGlVariant {
+        QGlShader         program;
+        future<QGlShader> sources;          // Read by a worker thread (warm() only)
+        bool              submitted = false;
+        bool              ready     = false;
+    };
+
+    QGlShader                          base;
+    vector<string>                     keys;
+    unordered_map<uint64_t, QGlVariant> variants;   // Mask -> program
+
+    QGlShader configure(uint64_t) const;
+
+public:
+    static const size_t MAX_KEYS = 64;
+
+    QGlShaderVariants() : QGlShaderVariants("") {}
+    QGlShaderVariants(const char* rootPath) : base(rootPath) {}
+
+    QGlShaderVariants& withShaders(const string, const string, const string = "");
+    QGlShaderVariants& withShaders(const string);
+    QGlShaderVariants& withKeys(const vector<string>&);
+    QGlShaderVariants& withStageCache(shared_ptr<QGlStageCache> stages) { this->base.withStageCache(stages); return *this; }
+
+    uint64_t mask(initializer_list<string>) const;
+
+    QGlShader& get(uint64_t);
+    QGlShader& use(uint64_t);
+    bool       isReady(uint64_t);
+
+    void   warm(const vector<uint64_t>&);
+    void   update();
+    void   release();
+    void   bindUniformBlocks();
+    size_t size() { return this->variants.size(); }
+};
+
+#endif
@@ -0,0 +1,54 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    watcher.hpp
+//
+// DESCRIPTION:
+// -----------
+// Non-blocking file change notifications (inotify on Linux).
+// On other systems, no change is ever reported.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifndef QGL_WATCHER_H
+#define QGL_WATCHER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+class QGlFileWatcher {
+private:
+    int fd = -1;
+    unordered_map<int, fs::path>   directories;     // Watch descriptor -> directory
+    unordered_set<string>          files;           // Watched files (normalized paths)
+
+public:
+    QGlFileWatcher() = default;
+    ~QGlFileWatcher();
+    QGlFileWatcher(const QGlFileWatcher&) = delete;
+    QGlFileWatcher& operator=(const QGlFileWatcher&) = delete;
+
+    bool watch(const fs::path&);
+    bool isWatching(const fs::path&);
+
+    /* Never blocks: returns the watched files changed since the last call */
+    vector<fs::path> poll();
+};
+
+#endif
@@ -25,11 +25,33 @@
 #include "qgl/common.hpp"
 #include "qgl/camera.hpp"
 #include "qgl/shader.hpp"
+#include "qgl/threadpool.hpp"
+#include "qgl/profiler.hpp"
+#include "qgl/triplebuffer.hpp"
+#include "qgl/events.hpp"
+#include "qgl/input.hpp"
+#include "qgl/watcher.hpp"
+#include "qgl/variants.hpp"
+#include "qgl/state.hpp"
+#include "qgl/ringbuffer.hpp"
+#include "qgl/batch.hpp"
+#include "qgl/compute.hpp"
+#include "qgl/texture.hpp"
+#include "qgl/mesh.hpp"
+#include "qgl/text.hpp"
+#include "qgl/capture.hpp"
 
 #include <string>
 #include <unordered_map>
 #include <functional>
 #include <filesystem>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <array>
+#include <vector>
+#include <memory>
+#include <future>
 
 namespace fs = std::filesystem;
 
@@ -68,21 +90,54 @@ enum QGlAction {
 };
 
 
+/* Snapshot of the state needed to render a frame. With a render thread, the
+ * main thread publishes one per input step and refresh() reads the latest. */
+struct QGlFrameState {
+    QGlCamera    camera;
+    QGlMouseData mouse;
+    float        deltaTime = 0.0f;
+    float        alpha     = 1.0f;
+    int          width     = 0;     // Framebuffer size
+    int          height    = 0;
+    uint64_t     frame     = 0;     // Input step that produced this snapshot
+};
+
+
 typedef unordered_map<string, QGlShader> QGlPrograms;
+typedef unordered_map<string, QGlShaderVariants> QGlProgramVariants;
+typedef unordered_map<string, QGlUniformBuffer>  QGlUniformBuffers;
 
 
 /* === NAMESPACE qgl::callback ===
  * Namespace to be extended with callback functions that might need to refer to
  * the QGlScene instance.
- * At each iteration, the QGlScene will bind itself to this namespace.
+ * Each QGlScene is stored as the user pointer of its window: use
+ * getInstance(window) to retrieve it.
  * */
+class QGlScene;
+
 namespace callback {
     void QGlDefaultCallback_Mouse(GLFWwindow*, double, double);
     void QGlDefaultCallback_FramebufferSize(GLFWwindow*, int, int);
     void QGlDefaultCallback_Scroll(GLFWwindow*, double, double);
+
+    /* Default GLFW callbacks: turn the raw callbacks into events for the queue of the scene */
+    void QGlEventCallback_FramebufferSize(GLFWwindow*, int, int);
+    void QGlEventCallback_MouseButton(GLFWwindow*, int, int, int);
+    void QGlEventCallback_CursorPosition(GLFWwindow*, double, double);
+    void QGlEventCallback_Scroll(GLFWwindow*, double, double);
+    void QGlEventCallback_Key(GLFWwindow*, int, int, int, int);
+
+    /* Default event handlers, registered by every QGlScene */
+    void QGlDefaultHandler_FramebufferSize(QGlScene&, const QGlEvent&);
+    void QGlDefaultHandler_CursorPosition(QGlScene&, const QGlEvent&);
+    void QGlDefaultHandler_Scroll(QGlScene&, const QGlEvent&);
 }
 
 
+typedef function<void(QGlScene&, const QGlEvent&)> QGlEventHandler;
+
+
 /*
  * A new instance creates an OpenGL window with independent properties.
  */
@@ -92,7 +147,18 @@ private:
 
     QGlPathInfo path;
 
-    GLFWwindow* window;         // The OpenGL window reference
+    GLFWwindow* window = nullptr;   // The OpenGL window reference (none if headless)
+
+    /* Headless mode: off-screen context rendering into a framebuffer object */
+    bool     headless = false;
+    atomic<bool> closing = false;   // Flag: headless equivalent of glfwWindowShouldClose
+    uint64_t maxFrames = 0;     // Stops run() after this many frames (0: never)
+    atomic<uint64_t> frameCount = 0;
+    void*    egl_display = nullptr;
+    void*    egl_context = nullptr;
+    GLuint   fbo = 0;
+    GLuint   fbo_color = 0;
+    GLuint   fbo_depth = 0;
 
     unsigned scr_height;        // Window height
     unsigned scr_width;         // Window width
@@ -102,24 +168,109 @@ private:
     float deltaTime = 0.0f;
     float lastFrame = 0.0f;
     float currentFrame;
+    chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+    /* Fixed-timestep simulation: processInput() runs at a fixed rate, refresh()
+     * once per frame with the interpolation factor between the last two ticks */
+    float    fixedStep   = 0.0f;    // Seconds per tick (0: once per frame)
+    unsigned maxSteps    = 5;       // Catch-up cap per frame
+    float    accumulator = 0.0f;
+    float    alpha       = 1.0f;
+
+    /* Frame rate limiter (useful with vsync off) */
+    chrono::steady_clock::duration   framePeriod = chrono::steady_clock::duration::zero();
+    chrono::steady_clock::time_point nextFrame;
+
+    /* Render thread: owns the context, and renders the latest frame state
+     * published by the main thread, which owns events and input */
+    bool                          renderThreaded = false;
+    atomic<bool>                  renderRunning  = false;
+    atomic<thread::id>            renderThreadId;
+    QGlTripleBuffer<QGlFrameState> frames;
+    QGlFrameState                 renderState;    // Frame state being rendered
+    uint64_t                      inputSteps = 0;
+
+    /* Meanwhile, the main thread handles input at most this often, and sooner
+     * when events arrive, never waiting for the render thread */
+    static constexpr chrono::microseconds INPUT_PERIOD { 1000 };
+
+    void runFrame();
+    void runThreaded();
+    void releaseGlfw();
+    void renderLoop();
+    void simulate(float);
+    void limitFrameRate();
+    void captureFrameState(QGlFrameState&);
+    void makeContextCurrent(bool);
+    bool onRenderThread() { return this->renderRunning && this_thread::get_id() == this->renderThreadId.load(); }
+
+    QGlProfiler profiler;       // Frame instrumentation (disabled by default)
 
     QGlMouseData mouse;         // Mouse last absolute position data
+    QGlInput     input;         // Key and mouse button state
     QGlCamera    camera;        // Camera manager
+    QGlState     state;         // State of the context of this scene
+    QGlTextureLoader textures;  // Uploads the textures loaded asynchronously
+    QGlCapture   capture;       // Reads the frames back, when capturing
 
-    QGlPrograms programs;       // Each program consists of a collection of shaders
+    shared_ptr<QGlPrograms> programs = make_shared<QGlPrograms>();  // Each program consists of a collection of shaders
+    shared_ptr<QGlProgramVariants> variants = make_shared<QGlProgramVariants>();    // Programs compiled per set of defines
+    shared_ptr<QGlStageCache>      stages   = make_shared<QGlStageCache>();         // Shader objects shared by the programs
+    shared_ptr<QGlUniformBuffers>  uniformBuffers = make_shared<QGlUniformBuffers>();   // Uniform block name -> buffer
 
-    GLFWframebuffersizefun framebuffer_size_callback = qgl::callback::QGlDefaultCallback_FramebufferSize;
-    GLFWmousebuttonfun     mousebtn_callback         = nullptr;
-    GLFWcursorposfun       mouse_callback            = qgl::callback::QGlDefaultCallback_Mouse;
-    GLFWscrollfun          scroll_callback           = qgl::callback::QGlDefaultCallback_Scroll;
+    QGlScene* sharedWith   = nullptr;   // Scene whose GL objects are shared with this one
+    bool      glfwAcquired = false;     // Flag: holds a reference to the GLFW library
+
+    GLFWframebuffersizefun framebuffer_size_callback = qgl::callback::QGlEventCallback_FramebufferSize;
+    GLFWmousebuttonfun     mousebtn_callback         = qgl::callback::QGlEventCallback_MouseButton;
+    GLFWcursorposfun       mouse_callback            = qgl::callback::QGlEventCallback_CursorPosition;
+    GLFWscrollfun          scroll_callback           = qgl::callback::QGlEventCallback_Scroll;
+    GLFWkeyfun             key_callback              = qgl::callback::QGlEventCallback_Key;
 
     void attachFrameBufferSizeCallback();
     void attachMouseButtonCallback();
     void attachCursorPositionCallback();
     void attachScrollCallback();
+    void attachKeyCallback();
+
+    /* Events pushed by the GLFW callbacks, dispatched once per frame */
+    static const size_t EVENT_QUEUE_CAPACITY = 1024;
+    QGlEventQueue<EVENT_QUEUE_CAPACITY> events;
+    array<vector<QGlEventHandler>, (size_t) QGlEventType::Count> handlers;
+
+    void registerDefaultHandlers();
+    void dispatchEvents();
+
 
+    bool parallelCompileQueried = false;   // Flag: enableParallelCompile() already ran
+
+    /* Hot reload: programs are rebuilt in the background when their files change */
+    struct QGlReload {
+        string            name;
+        future<QGlShader> sources;      // Read by a worker thread
+        QGlShader         staged;       // Built while the current program is still in use
+        bool              submitted = false;
+        bool              again     = false;    // Changed again meanwhile
+    };
+
+    bool           hotReload = false;
+    QGlFileWatcher watcher;
+    size_t         watchedPrograms = 0;
+    unordered_map<string, vector<string>>  watchedPaths;    // File -> program names
+    vector<QGlReload>                      reloads;
+    unordered_map<string, QGlShaderReport> reloadReports;   // Last failed reload of each program
+
+    void watchPrograms();
+    void scheduleReload(const string&);
+    void updateHotReload();
+    void updateVariants();
+    void releaseUniformBuffers();
 
     bool init_glfw();
+    bool init_egl();
+    void init_framebuffer();
+    void enableParallelCompile();
+    void* getProcAddress(const char*);
 
 #ifdef QGL_GLAD
     int init_glad();
@@ -135,9 +286,14 @@ public:
     void initialize();
     void initialize(const unsigned, const unsigned);
     void initialize(const unsigned, const unsigned, string);
+    void initializeHeadless(const unsigned, const unsigned);
     void finalize();
 
     bool launchSuccessful();
+    bool isHeadless() { return this->headless; }
+    bool shouldClose();
+    void close();
+    QGlScene& withMaxFrames(uint64_t frames) { this->maxFrames = frames; return *this; }
 
     void run();
     // virtual void refresh();
@@ -150,18 +306,51 @@ public:
 
     /* Properties and fields */
     GLFWwindow*   getWindow();
+    GLuint        getFramebuffer() { return this->fbo; }
     QGlMouseData& withMouseData();
     [[deprecated]] QGlMouseData& getMouseData();
     void          setMouseData(float, float, bool);
 
     QGlShader& withProgram(string);
-    QGlCamera& withCamera() { return this->camera; }
+    QGlShaderVariants& withVariants(string);
+    QGlStageCacheStats getStageCacheStats() { return this->stages->getStats(); }
+    QGlUniformBuffer&  withUniformBuffer(const string&);
+    void               uploadUniformBuffers();
+    bool       buildPrograms();
+    QGlScene&  withHotReload(bool = true);
+    QGlShaderReport getReloadReport(const string&);
+    bool       hasExtension(const string&);
+    QGlCamera& withCamera();
+    QGlState&  withState() { return this->state; }
+    QGlInput&  withInput() { return this->input; }
+    QGlProfiler& withProfiler() { return this->profiler; }
+    QGlTextureLoader& withTextures() { return this->textures; }
+    QGlCapture&  withCapture() { return this->capture; }
+
+    float getTime();
+    float getDeltaTime();
+    float getAlpha();
+    QGlFrameState getFrameState();
+
+    QGlScene& withFixedTimestep(float, unsigned = 5);
+    QGlScene& withFrameRateLimit(float);
+    QGlScene& withRenderThread(bool = true);
+    QGlScene& withSharedContext(QGlScene&);
+
+    static void runAll(vector<QGlScene*>);
 
     /* Callbacks */
     void setFrameBufferSizeCallback(GLFWframebuffersizefun, bool = true);
     void setMouseButtonCallback(GLFWmousebuttonfun, bool = true);
     void setCursorPositionCallback(GLFWcursorposfun, bool = true);
     void setScrollCallback(GLFWscrollfun, bool = true);
+    void setKeyCallback(GLFWkeyfun, bool = true);
+
+    /* Events */
+    QGlScene& on(QGlEventType, QGlEventHandler);
+    QGlScene& clearHandlers(QGlEventType);
+    void      pushEvent(const QGlEvent&);
+    size_t    getDroppedEvents() { return this->events.getDropped(); }
 
     // Constructor and destructor
     QGlScene() : QGlScene("") {};
@@ -173,6 +362,7 @@ public:
 namespace callback {
     void bindInstance(QGlScene*);
     QGlScene* getInstance();
+    QGlScene* getInstance(GLFWwindow*);
 }
 
 }
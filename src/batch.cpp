@@ -0,0 +1,231 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    batch.cpp
+//
+// DESCRIPTION:
+// -----------
+// Instanced batch renderer: draws are recorded, sorted by program, mesh and
+// material, and issued as one instanced draw per unique combination, with the
+// per-instance data streamed through a ring buffer.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/batch.hpp"
+#include "qgl/hash.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+
+/* Sort key: program in the highest bits, so that programs change the least,
+ * then mesh, then material. */
+static const int      QGL_BATCH_PROGRAM_SHIFT = 44;     // 20 bits
+static const int      QGL_BATCH_MESH_SHIFT    = 24;     // 20 bits
+static const uint64_t QGL_BATCH_MESH_MASK     = (1ull << 20) - 1;
+static const uint64_t QGL_BATCH_MATERIAL_MASK = (1ull << 24) - 1;
+
+
+QGlBatch& QGlBatch::withInstanceLayout(GLsizei stride, const vector<QGlInstanceAttribute>& layout) {
+    this->stride = stride;
+    this->layout = layout;
+    this->clear();
+    return *this;
+}
+
+
+/* The streaming buffer holds up to the given number of instances per flush,
+ * in each of its regions (flushing more than once per frame takes a region
+ * each time). */
+bool QGlBatch::create(uint32_t maxInstances, uint32_t regions) {
+    if (this->stride <= 0 || maxInstances == 0)
+        return false;
+    return this->instances.create(GLsizeiptr(maxInstances) * this->stride, GL_ARRAY_BUFFER, regions);
+}
+
+
+void QGlBatch::release() {
+    this->instances.release();
+    this->clear();
+}
+
+
+/* Meshes are numbered per flush, and told apart by content, so that a mesh
+ * rebuilt every frame still batches with its previous copies. */
+uint32_t QGlBatch::meshIndex(const QGlMesh& mesh) {
+    uint64_t hash = qglHashBytes(&mesh.vao, sizeof(mesh.vao));
+    hash = qglHashBytes(&mesh.mode,        sizeof(mesh.mode),        hash);
+    hash = qglHashBytes(&mesh.count,       sizeof(mesh.count),       hash);
+    hash = qglHashBytes(&mesh.indexType,   sizeof(mesh.indexType),   hash);
+    hash = qglHashBytes(&mesh.indexOffset, sizeof(mesh.indexOffset), hash);
+    hash = qglHashBytes(&mesh.baseVertex,  sizeof(mesh.baseVertex),  hash);
+
+    auto it = this->meshIndices.find(hash);
+    if (it != this->meshIndices.end()) {
+        const QGlMesh& known = this->meshes[it->second];
+        if (known.vao == mesh.vao && known.mode == mesh.mode && known.count == mesh.count &&
+            known.indexType == mesh.indexType && known.indexOffset == mesh.indexOffset &&
+            known.baseVertex == mesh.baseVertex)
+            return it->second;
+    } else if (this->meshes.size() <= QGL_BATCH_MESH_MASK) {
+        this->meshIndices[hash] = this->meshes.size();
+    }
+    this->meshes.push_back(mesh);       // Unique, or a collision: drawn on its own
+    return this->meshes.size() - 1;
+}
+
+
+/* Records a draw of one instance: its data (stride bytes, as laid out with
+ * withInstanceLayout()) is copied, so it may change right after the call. */
+void QGlBatch::submit(QGlShader& program, const QGlMesh& mesh, const void* data, uint32_t material) {
+    if (this->stride <= 0 || mesh.vao == 0 || mesh.count <= 0)
+        return;
+
+    QGlDrawCommand command;
+    command.program  = program.getID();
+    command.mesh     = this->meshIndex(mesh);
+    command.material = material;
+    command.data     = this->staging.size();
+    command.key      = (uint64_t(command.program) << QGL_BATCH_PROGRAM_SHIFT)
+                     | ((uint64_t(command.mesh) & QGL_BATCH_MESH_MASK) << QGL_BATCH_MESH_SHIFT)
+                     | (uint64_t(material) & QGL_BATCH_MATERIAL_MASK);
+    this->commands.push_back(command);
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    this->staging.insert(this->staging.end(), bytes, bytes + this->stride);
+}
+
+
+/* LSD radix sort of the commands by key, one byte per pass. It is stable, and
+ * the passes over bytes that are the same in every key (usually most of them:
+ * few programs, few meshes) are skipped. */
+void QGlBatch::sort() {
+    size_t count = this->commands.size();
+    if (count < 2)
+        return;
+
+    uint64_t differ = 0;
+    for (const QGlDrawCommand& command : this->commands)
+        differ |= command.key ^ this->commands[0].key;
+
+    this->scratch.resize(count);
+    vector<QGlDrawCommand>* from = &this->commands;
+    vector<QGlDrawCommand>* to   = &this->scratch;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((differ >> shift) & 0xFF) == 0)
+            continue;
+
+        size_t offsets[256] = {};
+        for (const QGlDrawCommand& command : *from)
+            offsets[(command.key >> shift) & 0xFF]++;
+        size_t total = 0;
+        for (size_t& offset : offsets) {
+            size_t n = offset;
+            offset = total;
+            total += n;
+        }
+        for (const QGlDrawCommand& command : *from)
+            (*to)[offsets[(command.key >> shift) & 0xFF]++] = command;
+        swap(from, to);
+    }
+
+    if (from != &this->commands)
+        this->commands.swap(this->scratch);
+}
+
+
+/* Points the instance attributes of the bound vertex array to this flush's data. */
+void QGlBatch::bindInstances(GLintptr offset) {
+    this->instances.bind();
+    for (const QGlInstanceAttribute& attribute : this->layout) {
+        const void* pointer = (const void*) (offset + attribute.offset);
+        glEnableVertexAttribArray(attribute.location);
+        if (attribute.integer)
+            glVertexAttribIPointer(attribute.location, attribute.components, attribute.type, this->stride, pointer);
+        else
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type,
+                                  attribute.normalized, this->stride, pointer);
+        glVertexAttribDivisor(attribute.location, 1);
+    }
+}
+
+
+/* Sorts the recorded draws and issues them, one instanced draw per run of
+ * draws with the same program, mesh and material (not just the same key,
+ * which keeps only the low bits of each): the instance data is copied in sorted order, so
+ * each run reads a contiguous range, selected with its base instance. */
+void QGlBatch::flush() {
+    this->stats = QGlBatchStats();
+    this->stats.commands = this->commands.size();
+    if (this->commands.empty() || this->instances.getBuffer() == 0) {
+        this->clear();
+        return;
+    }
+    this->sort();
+
+    this->instances.beginFrame();
+    size_t count = min<size_t>(this->commands.size(), this->instances.getCapacity() / this->stride);
+    QGlRingAllocation allocation = this->instances.allocate(GLsizeiptr(count) * this->stride);
+    if (!allocation.valid())
+        count = 0;
+    this->stats.dropped = this->commands.size() - count;
+
+    uint8_t* instanceData = static_cast<uint8_t*>(allocation.data);
+    for (size_t i = 0; i < count; i++)
+        memcpy(instanceData + i * this->stride, this->staging.data() + this->commands[i].data, this->stride);
+
+    QGlState& state = QGlState::current();
+    GLuint   program  = 0, vertexArray = 0;
+    uint32_t material = 0;
+    bool     first    = true;
+
+    for (size_t begin = 0, end; begin < count; begin = end) {
+        const QGlDrawCommand& command = this->commands[begin];
+        for (end = begin + 1; end < count && this->commands[end].sameDraw(command); end++);
+
+        const QGlMesh& mesh = this->meshes[command.mesh];
+        bool programChanged = first || command.program != program;
+        if (programChanged) {
+            state.useProgram(command.program);
+            program = command.program;
+            this->stats.programs++;
+        }
+        if (first || mesh.vao != vertexArray) {
+            state.bindVertexArray(mesh.vao);
+            this->bindInstances(allocation.offset);
+            vertexArray = mesh.vao;
+        }
+        if (programChanged || command.material != material) {     // Material uniforms belong to the program
+            this->applyMaterial(command.material);
+            material = command.material;
+            this->stats.materials++;
+        }
+        first = false;
+
+        glDrawElementsInstancedBaseVertexBaseInstance(mesh.mode, mesh.count, mesh.indexType,
+            (const void*) mesh.indexOffset, GLsizei(end - begin), mesh.baseVertex, GLuint(begin));
+        this->stats.draws++;
+    }
+
+    this->instances.endFrame();
+    this->clear();
+}
+
+
+/* Drops the recorded draws, keeping the memory for the next frame. */
+void QGlBatch::clear() {
+    this->commands.clear();
+    this->staging.clear();
+    this->meshes.clear();
+    this->meshIndices.clear();
+}
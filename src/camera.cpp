@@ -17,6 +17,7 @@
 //------------------------------------------------------------------------------
 
 #include "qgl/camera.hpp"
+#include "qgl/simd.hpp"
 
 QGlCamera::QGlCamera(glm::vec3 position, glm::vec3 up, float yaw, float pitch) :
     position(position),
@@ -26,7 +27,10 @@ QGlCamera::QGlCamera(glm::vec3 position, glm::vec3 up, float yaw, float pitch) :
     pitch(pitch),
     movementSpeed(SPEED),
     mouseSensitivity(SENSITIVITY),
-    zoom(ZOOM)
+    zoom(ZOOM),
+    aspectRatio(ASPECT),
+    nearPlane(NEAR_PLANE),
+    farPlane(FAR_PLANE)
 {
     updateCameraVectors();
 }
@@ -40,18 +44,55 @@ QGlCamera::QGlCamera(float posX, float posY, float posZ, float upX, float upY, f
     pitch(pitch),
     movementSpeed(SPEED),
     mouseSensitivity(SENSITIVITY),
-    zoom(ZOOM)
+    zoom(ZOOM),
+    aspectRatio(ASPECT),
+    nearPlane(NEAR_PLANE),
+    farPlane(FAR_PLANE)
 {
     updateCameraVectors();
 }
 
 
-glm::mat4 QGlCamera::getViewMatrix() {
-    return glm::lookAt(position, position + front, up);
+const glm::mat4& QGlCamera::getViewMatrix() {
+    applyAngles();
+    if (viewChanged) {
+        view = glm::lookAt(position, position + front, up);
+        viewChanged = false;
+        viewProjectionChanged = true;
+    }
+    return view;
+}
+
+
+const glm::mat4& QGlCamera::getProjectionMatrix() {
+    if (projectionChanged) {
+        projection = glm::perspective(glm::radians(zoom), aspectRatio, nearPlane, farPlane);
+        projectionChanged = false;
+        viewProjectionChanged = true;
+    }
+    return projection;
+}
+
+
+const glm::mat4& QGlCamera::getViewProjectionMatrix() {
+    getViewMatrix();
+    getProjectionMatrix();
+    if (viewProjectionChanged) {
+        viewProjection = projection * view;
+        viewProjectionChanged = false;
+    }
+    return viewProjection;
+}
+
+
+QGlFrustum QGlCamera::getFrustum() {
+    return QGlFrustum(getViewProjectionMatrix());
 }
 
 
 void QGlCamera::processKeyboard(Camera_Movement direction, float deltaTime) {
+    applyAngles();
+    viewChanged = true;
     float velocity = movementSpeed * deltaTime;
     if (direction == FORWARD)
         position += front * velocity;
@@ -79,8 +120,8 @@ void QGlCamera::processMouseMovement(float xoffset, float yoffset, GLboolean con
             pitch = -89.0f;
     }
 
-    // Update front, right and up Vectors using the updated Euler angles
-    updateCameraVectors();
+    // Front, right and up vectors are updated from the Euler angles when next needed
+    anglesChanged = true;
 }
 
 
@@ -91,6 +132,7 @@ void QGlCamera::processMouseScroll(float yoffset) {
         zoom = 1.0f;
     if (zoom >= 45.0f)
         zoom = 45.0f;
+    projectionChanged = true;
 }
 
 
@@ -100,46 +142,66 @@ void QGlCamera::updateCameraVectors() {
     front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
     front.y = sin(glm::radians(pitch));
     front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-    front   = glm::normalize(front);
+    this->front = glm::normalize(front);
 
     // Also re-calculate the right and up vector
     right = glm::normalize(glm::cross(front, worldUp));  // Normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
     up    = glm::normalize(glm::cross(right, front));
+    viewChanged = true;
+}
+
+
+void QGlCamera::applyAngles() {
+    if (anglesChanged) {
+        anglesChanged = false;
+        updateCameraVectors();
+    }
 }
 
 
 QGlCamera& QGlCamera::withPosition(glm::vec3 position) {
     this->position = position;
+    this->viewChanged = true;
     return *this;
 }
 
 QGlCamera& QGlCamera::withFront(glm::vec3 front) {
+    applyAngles();
     this->front = front;
+    this->viewChanged = true;
     return *this;
 }
 
 QGlCamera& QGlCamera::withUp(glm::vec3 up) {
+    applyAngles();
     this->up = up;
+    this->viewChanged = true;
     return *this;
 }
 
 QGlCamera& QGlCamera::withRight(glm::vec3 right) {
+    applyAngles();
     this->right = right;
+    this->viewChanged = true;
     return *this;
 }
 
 QGlCamera& QGlCamera::withWorldUp(glm::vec3 worldUp) {
+    applyAngles();
     this->worldUp = worldUp;
+    this->viewChanged = true;
     return *this;
 }
 
 QGlCamera& QGlCamera::withYaw(float yaw) {
     this->yaw = yaw;
+    this->anglesChanged = true;
     return *this;
 }
 
 QGlCamera& QGlCamera::withPitch(float pitch) {
     this->pitch = pitch;
+    this->anglesChanged = true;
     return *this;
 }
 
@@ -155,17 +217,192 @@ QGlCamera& QGlCamera::withMouseSensitivity(float mouseSens) {
 
 QGlCamera& QGlCamera::withZoom(float zoom) {
     this->zoom = zoom;
+    this->projectionChanged = true;
+    return *this;
+}
+
+QGlCamera& QGlCamera::withAspectRatio(float aspectRatio) {
+    this->aspectRatio = aspectRatio;
+    this->projectionChanged = true;
+    return *this;
+}
+
+QGlCamera& QGlCamera::withNearPlane(float nearPlane) {
+    this->nearPlane = nearPlane;
+    this->projectionChanged = true;
+    return *this;
+}
+
+QGlCamera& QGlCamera::withFarPlane(float farPlane) {
+    this->farPlane = farPlane;
+    this->projectionChanged = true;
     return *this;
 }
 
 
 glm::vec3 QGlCamera::getPosition()         { return this->position; }
-glm::vec3 QGlCamera::getFront()            { return this->front; }
-glm::vec3 QGlCamera::getUp()               { return this->up; }
-glm::vec3 QGlCamera::getRight()            { return this->right; }
+glm::vec3 QGlCamera::getFront()            { applyAngles(); return this->front; }
+glm::vec3 QGlCamera::getUp()               { applyAngles(); return this->up; }
+glm::vec3 QGlCamera::getRight()            { applyAngles(); return this->right; }
 glm::vec3 QGlCamera::getWorldUp()          { return this->worldUp; }
 float     QGlCamera::getYaw()              { return this->yaw; }
 float     QGlCamera::getPitch()            { return this->pitch; }
 float     QGlCamera::getMovementSpeed()    { return this->movementSpeed; }
 float     QGlCamera::getMouseSensitivity() { return this->mouseSensitivity; }
 float     QGlCamera::getZoom()             { return this->zoom; }
+float     QGlCamera::getAspectRatio()      { return this->aspectRatio; }
+float     QGlCamera::getNearPlane()        { return this->nearPlane; }
+float     QGlCamera::getFarPlane()         { return this->farPlane; }
+
+
+size_t QGlCameraArray::add(glm::vec3 position, float yaw, float pitch, float fov, float aspectRatio, float nearPlane, float farPlane) {
+    this->x.push_back(position.x);
+    this->y.push_back(position.y);
+    this->z.push_back(position.z);
+    this->yaw.push_back(yaw);
+    this->pitch.push_back(pitch);
+    this->fov.push_back(fov);
+    this->aspectRatio.push_back(aspectRatio);
+    this->nearPlane.push_back(nearPlane);
+    this->farPlane.push_back(farPlane);
+    return this->size() - 1;
+}
+
+
+/* Copies the position, angles and projection of the camera (not its world up vector). */
+size_t QGlCameraArray::add(QGlCamera& camera) {
+    return this->add(camera.getPosition(), camera.getYaw(), camera.getPitch(), camera.getZoom(),
+                     camera.getAspectRatio(), camera.getNearPlane(), camera.getFarPlane());
+}
+
+
+void QGlCameraArray::clear() {
+    for (vector<float>* v : { &x, &y, &z, &yaw, &pitch, &fov, &aspectRatio, &nearPlane, &farPlane })
+        v->clear();
+}
+
+
+#ifdef QGL_SSE
+
+/* Four floats, one per camera, with the arithmetic used by QGlCameraMatrices(). */
+struct QGlFloat4 {
+    __m128 v;
+    QGlFloat4() = default;
+    QGlFloat4(__m128 v) : v(v) {}
+    QGlFloat4(float f)  : v(_mm_set1_ps(f)) {}
+};
+
+static inline QGlFloat4 operator+(QGlFloat4 a, QGlFloat4 b) { return _mm_add_ps(a.v, b.v); }
+static inline QGlFloat4 operator-(QGlFloat4 a, QGlFloat4 b) { return _mm_sub_ps(a.v, b.v); }
+static inline QGlFloat4 operator*(QGlFloat4 a, QGlFloat4 b) { return _mm_mul_ps(a.v, b.v); }
+static inline QGlFloat4 QGlInverseLength(QGlFloat4 squared) { return _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(squared.v)); }
+
+#endif
+
+static inline float QGlInverseLength(float squared) { return 1.0f / sqrt(squared); }
+
+
+/* The same calculations as QGlCamera (front, right and up vectors, lookAt and
+ * perspective), written once for one camera (F = float) or several (vectors). */
+template <class F>
+static void QGlCameraMatrices(F x, F y, F z, F sinYaw, F cosYaw, F sinPitch, F cosPitch,
+                              F projX, F projY, F projZ, F projW, glm::vec3 worldUp,
+                              F view[4][4], F viewProjection[4][4]) {
+    F fx = cosYaw * cosPitch, fy = sinPitch, fz = sinYaw * cosPitch;    // Front
+
+    F rx = fy * F(worldUp.z) - fz * F(worldUp.y);                       // Right: normalize(cross(front, worldUp))
+    F ry = fz * F(worldUp.x) - fx * F(worldUp.z);
+    F rz = fx * F(worldUp.y) - fy * F(worldUp.x);
+    F inverse = QGlInverseLength(rx * rx + ry * ry + rz * rz);
+    rx = rx * inverse;
+    ry = ry * inverse;
+    rz = rz * inverse;
+
+    F ux = ry * fz - rz * fy;                                           // Up: cross(right, front)
+    F uy = rz * fx - rx * fz;
+    F uz = rx * fy - ry * fx;
+
+    F zero(0.0f), one(1.0f);
+    F columns[4][4] = {
+        { rx, ux, zero - fx, zero },
+        { ry, uy, zero - fy, zero },
+        { rz, uz, zero - fz, zero },
+        { zero - (rx * x + ry * y + rz * z), zero - (ux * x + uy * y + uz * z), fx * x + fy * y + fz * z, one }
+    };
+    for (int j = 0; j < 4; j++) {                                       // The projection only has 5 terms
+        for (int k = 0; k < 4; k++)
+            view[j][k] = columns[j][k];
+        viewProjection[j][0] = projX * columns[j][0];
+        viewProjection[j][1] = projY * columns[j][1];
+        viewProjection[j][2] = projZ * columns[j][2] + projW * columns[j][3];
+        viewProjection[j][3] = zero - columns[j][2];
+    }
+}
+
+
+/* Calculates the matrices of every camera: the trigonometry first, one camera
+ * at a time, then the rest, several cameras at a time. */
+void QGlCameraArray::update() {
+    size_t count = this->size();
+    for (vector<float>* v : { &sinYaw, &cosYaw, &sinPitch, &cosPitch, &projX, &projY, &projZ, &projW })
+        v->resize(count);
+    this->views.resize(count);
+    this->projections.resize(count);
+    this->viewProjections.resize(count);
+
+    for (size_t i = 0; i < count; i++) {
+        sinYaw[i]   = sin(glm::radians(yaw[i]));
+        cosYaw[i]   = cos(glm::radians(yaw[i]));
+        sinPitch[i] = sin(glm::radians(pitch[i]));
+        cosPitch[i] = cos(glm::radians(pitch[i]));
+
+        float tangent = tan(glm::radians(fov[i]) / 2.0f);
+        float depth   = farPlane[i] - nearPlane[i];
+        projX[i] = 1.0f / (aspectRatio[i] * tangent);
+        projY[i] = 1.0f / tangent;
+        projZ[i] = -(farPlane[i] + nearPlane[i]) / depth;
+        projW[i] = -(2.0f * farPlane[i] * nearPlane[i]) / depth;
+
+        glm::mat4& projection = this->projections[i];
+        projection = glm::mat4(0.0f);
+        projection[0][0] = projX[i];
+        projection[1][1] = projY[i];
+        projection[2][2] = projZ[i];
+        projection[2][3] = -1.0f;
+        projection[3][2] = projW[i];
+    }
+
+    size_t i = 0;
+#ifdef QGL_SSE
+    for (; i + 4 <= count; i += 4) {
+        QGlFloat4 view[4][4], viewProjection[4][4];
+        QGlCameraMatrices<QGlFloat4>(_mm_loadu_ps(&x[i]), _mm_loadu_ps(&y[i]), _mm_loadu_ps(&z[i]),
+            _mm_loadu_ps(&sinYaw[i]), _mm_loadu_ps(&cosYaw[i]), _mm_loadu_ps(&sinPitch[i]), _mm_loadu_ps(&cosPitch[i]),
+            _mm_loadu_ps(&projX[i]), _mm_loadu_ps(&projY[i]), _mm_loadu_ps(&projZ[i]), _mm_loadu_ps(&projW[i]),
+            this->worldUp, view, viewProjection);
+
+        // Each element holds 4 cameras: transposed, each row becomes a column of a camera
+        for (int j = 0; j < 4; j++) {
+            __m128 v[4]  = { view[j][0].v, view[j][1].v, view[j][2].v, view[j][3].v };
+            __m128 vp[4] = { viewProjection[j][0].v, viewProjection[j][1].v, viewProjection[j][2].v, viewProjection[j][3].v };
+            _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+            _MM_TRANSPOSE4_PS(vp[0], vp[1], vp[2], vp[3]);
+            for (int k = 0; k < 4; k++) {
+                _mm_storeu_ps(&this->views[i + k][j][0], v[k]);
+                _mm_storeu_ps(&this->viewProjections[i + k][j][0], vp[k]);
+            }
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        float view[4][4], viewProjection[4][4];
+        QGlCameraMatrices<float>(x[i], y[i], z[i], sinYaw[i], cosYaw[i], sinPitch[i], cosPitch[i],
+                                 projX[i], projY[i], projZ[i], projW[i], this->worldUp, view, viewProjection);
+        for (int j = 0; j < 4; j++)
+            for (int k = 0; k < 4; k++) {
+                this->views[i][j][k]           = view[j][k];
+                this->viewProjections[i][j][k] = viewProjection[j][k];
+            }
+    }
+}
@@ -0,0 +1,424 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    capture.cpp
+//
+// DESCRIPTION:
+// -----------
+// Frame capture: asynchronous readback of the framebuffer through pixel pack
+// buffers, and a writer thread saving the frames as PNG or raw files, or
+// streaming them to the standard input of a command.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/capture.hpp"
+#include "qgl/state.hpp"
+
+#include <fstream>
+#include <array>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <algorithm>
+
+#ifdef _WIN32
+    #define popen  _popen
+    #define pclose _pclose
+#else
+    #include <csignal>
+    #include <pthread.h>
+#endif
+
+
+/* The name of a frame: the first %d (with optional zero padding and width,
+ * e.g. %06d) of the pattern replaced by its number. Empty if there is none. */
+static string QGlFrameName(const string& pattern, uint64_t index) {
+    size_t percent = pattern.find('%');
+    if (percent == string::npos)
+        return "";
+    size_t end = percent + 1;
+    bool   zero = (end < pattern.size() && pattern[end] == '0');
+    size_t width = 0;
+    for (end += zero; end < pattern.size() && isdigit((unsigned char) pattern[end]); end++)
+        width = width * 10 + (pattern[end] - '0');
+    if (end >= pattern.size() || pattern[end] != 'd')
+        return "";
+
+    string number = to_string(index);
+    if (number.size() < width)
+        number.insert(0, width - number.size(), zero ? '0' : ' ');
+    return pattern.substr(0, percent) + number + pattern.substr(end + 1);
+}
+
+
+static uint32_t QGlCRC32(const uint8_t* data, size_t size, uint32_t crc) {
+    static const auto table = []() {
+        array<uint32_t, 256> table;
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return table;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+
+/* PNG with stored (uncompressed) deflate blocks: no zlib, and as fast to
+ * write as the raw pixels. The zlib stream is written as it is produced, in
+ * one IDAT chunk, whose length is known in advance. */
+bool QGlCapture::writePNG(const fs::path& path, const uint8_t* rgba, int width, int height, string& error) {
+    ofstream stream(path, ios::binary | ios::trunc);
+    if (!stream) {
+        error = path.string() + ": " + strerror(errno);
+        return false;
+    }
+
+    uint32_t crc = 0;
+    auto put = [&](const void* data, size_t size) {
+        stream.write((const char*) data, size);
+        crc = QGlCRC32((const uint8_t*) data, size, crc);
+    };
+    auto put32 = [&](uint32_t value) {
+        uint8_t bytes[4] = { uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value) };
+        put(bytes, 4);
+    };
+    auto chunk = [&](const char* type, uint32_t length) {
+        put32(length);
+        crc = 0;
+        put(type, 4);
+    };
+    auto seal = [&]() {
+        uint32_t value = crc;
+        put32(value);
+    };
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    stream.write((const char*) signature, sizeof(signature));
+
+    chunk("IHDR", 13);
+    put32(width);
+    put32(height);
+    const uint8_t header[5] = { 8, 6, 0, 0, 0 };        // 8 bits, RGBA, deflate, no filter, not interlaced
+    put(header, sizeof(header));
+    seal();
+
+    // Each row is preceded by its filter type (0: none)
+    const size_t   BLOCK  = 65535;
+    const size_t   row    = size_t(width) * 4;
+    const uint64_t raw    = uint64_t(height) * (row + 1);
+    const uint64_t blocks = max<uint64_t>(1, (raw + BLOCK - 1) / BLOCK);
+    chunk("IDAT", 2 + raw + 5 * blocks + 4);
+    const uint8_t zlib[2] = { 0x78, 0x01 };
+    put(zlib, 2);
+
+    uint32_t a = 1, b = 0;                              // Adler-32
+    uint64_t left = raw, inBlock = 0;
+    auto emit = [&](const uint8_t* data, size_t size) {
+        while (size > 0) {
+            if (inBlock == 0) {
+                inBlock = min<uint64_t>(left, BLOCK);
+                left   -= inBlock;
+                const uint8_t block[5] = { uint8_t(left == 0), uint8_t(inBlock), uint8_t(inBlock >> 8),
+                                           uint8_t(~inBlock), uint8_t(~inBlock >> 8) };
+                put(block, 5);
+            }
+            size_t n = min<uint64_t>(size, inBlock);
+            put(data, n);
+            for (size_t done = 0; done < n; ) {         // Sums kept below the modulus for 5552 bytes
+                size_t step = min<size_t>(n - done, 5552);
+                for (size_t i = 0; i < step; i++) {
+                    a += data[done + i];
+                    b += a;
+                }
+                a %= 65521;
+                b %= 65521;
+                done += step;
+            }
+            data    += n;
+            size    -= n;
+            inBlock -= n;
+        }
+    };
+    const uint8_t filter = 0;
+    for (int y = 0; y < height; y++) {
+        emit(&filter, 1);
+        emit(rgba + y * row, row);
+    }
+    put32((b << 16) | a);
+    seal();
+
+    chunk("IEND", 0);
+    seal();
+
+    stream.close();
+    if (!stream) {
+        error = path.string() + ": write failed";
+        return false;
+    }
+    return true;
+}
+
+
+QGlCapture::~QGlCapture() {
+    this->stopWriter();
+}
+
+
+/* Readbacks in flight at most: frames are mapped up to that many frames after
+ * they were read back. Set before start(). */
+QGlCapture& QGlCapture::withDepth(uint32_t depth) {
+    this->depth = max(depth, 2u);
+    return *this;
+}
+
+
+/* Frames waiting for the writer at most, beyond which frames are dropped. */
+QGlCapture& QGlCapture::withQueue(size_t frames) {
+    this->queueLimit = max<size_t>(frames, 1);
+    return *this;
+}
+
+
+/* Target: a pattern of file names, or the command to stream frames to. */
+bool QGlCapture::start(const string& target, QGlCaptureFormat format) {
+    this->stop();
+    {
+        lock_guard<mutex> guard(this->lock);
+        this->stats = QGlCaptureStats();
+        this->error.clear();
+    }
+    if (format != QGlCaptureFormat::Pipe && QGlFrameName(target, 0).empty()) {
+        this->error = "Capture: the file pattern needs a %d for the frame number: " + target;
+        return false;
+    }
+    if (format == QGlCaptureFormat::Pipe) {
+        this->pipe = popen(target.c_str(), "w");
+        if (this->pipe == nullptr) {
+            this->error = "Capture: cannot run " + target + ": " + strerror(errno);
+            return false;
+        }
+    }
+
+    this->target    = target;
+    this->format    = format;
+    this->frames    = 0;
+    this->slots.assign(this->depth, QGlCaptureSlot());
+    this->oldest    = 0;
+    this->inFlight  = 0;
+    this->stopping  = false;
+    this->failed    = false;
+    this->writer    = thread(&QGlCapture::write, this);
+    this->capturing = true;
+    return true;
+}
+
+
+/* Maps the readbacks the GPU has finished (or, waiting, all of them), oldest
+ * first, and queues them for the writer, with the rows top to bottom. */
+void QGlCapture::collect(bool wait) {
+    QGlState& state = QGlState::current();
+    while (this->inFlight > 0) {
+        QGlCaptureSlot& slot = this->slots[this->oldest];
+        GLenum result = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000 : 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            if (wait)
+                continue;
+            break;
+        }
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+
+        size_t row = size_t(slot.width) * 4;
+        QGlCaptureFrame frame { this->staging.acquire(row * slot.height), slot.width, slot.height, this->frames++ };
+        state.bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        const uint8_t* pixels = (const uint8_t*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, row * slot.height, GL_MAP_READ_BIT);
+        if (pixels != nullptr) {
+            for (int y = 0; y < slot.height; y++)
+                memcpy(frame.pixels.data() + y * row, pixels + (slot.height - 1 - y) * row, row);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        this->oldest = (this->oldest + 1) % this->slots.size();
+        this->inFlight--;
+
+        lock_guard<mutex> guard(this->lock);
+        if (pixels == nullptr || this->queue.size() >= this->queueLimit) {
+            this->staging.recycle(move(frame.pixels));
+            this->stats.dropped++;
+            continue;
+        }
+        this->queue.push_back(move(frame));
+        this->wakeup.notify_one();
+    }
+    state.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+/* Once per frame, after rendering and before swapping: reads the color of the
+ * framebuffer back (binding it for reading), and queues the frames whose
+ * readback has finished. */
+void QGlCapture::readback(GLuint framebuffer, int width, int height) {
+    if (!this->capturing || width <= 0 || height <= 0)
+        return;
+    if (this->failed) {
+        this->stop();
+        return;
+    }
+    this->collect(false);
+    if (this->inFlight == this->slots.size()) {
+        lock_guard<mutex> guard(this->lock);
+        this->stats.dropped++;
+        return;
+    }
+
+    QGlState& state = QGlState::current();
+    QGlCaptureSlot& slot = this->slots[(this->oldest + this->inFlight) % this->slots.size()];
+    GLsizeiptr size = GLsizeiptr(width) * height * 4;
+    if (slot.buffer == 0)
+        glGenBuffers(1, &slot.buffer);
+    state.bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.size != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        slot.size = size;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    slot.fence  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width  = width;
+    slot.height = height;
+    state.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    this->inFlight++;
+
+    lock_guard<mutex> guard(this->lock);
+    this->stats.captured++;
+}
+
+
+/* Writes the frames still in flight, then waits for the writer to finish:
+ * the only call that waits for the GPU and the disk. */
+void QGlCapture::stop() {
+    if (!this->capturing)
+        return;
+    if (!this->failed)
+        this->collect(true);
+    this->stopWriter();
+
+    QGlState& state = QGlState::current();
+    for (QGlCaptureSlot& slot : this->slots) {
+        if (slot.fence != nullptr)          // Not collected: the writer failed
+            glDeleteSync(slot.fence);
+        if (slot.buffer != 0) {
+            state.forgetBuffer(slot.buffer);
+            glDeleteBuffers(1, &slot.buffer);
+        }
+    }
+    this->slots.clear();
+    this->queue.clear();
+    this->inFlight  = 0;
+    this->capturing = false;
+}
+
+
+void QGlCapture::stopWriter() {
+    {
+        lock_guard<mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->wakeup.notify_all();
+    if (this->writer.joinable())
+        this->writer.join();
+}
+
+
+/* The writer thread: empties the queue before stopping, unless the pipe was
+ * closed. It also closes the pipe, so that no write happens elsewhere. */
+void QGlCapture::write() {
+#ifndef _WIN32
+    // A closed pipe fails the writes with EPIPE instead of killing the process
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+#endif
+
+    while (!this->failed) {
+        QGlCaptureFrame frame;
+        {
+            unique_lock<mutex> guard(this->lock);
+            this->wakeup.wait(guard, [this]() { return this->stopping || !this->queue.empty(); });
+            if (this->queue.empty())
+                break;
+            frame = move(this->queue.front());
+            this->queue.pop_front();
+        }
+
+        string error;
+        bool written = this->writeFrame(frame, error);
+        this->staging.recycle(move(frame.pixels));
+
+        lock_guard<mutex> guard(this->lock);
+        if (written)
+            this->stats.written++;
+        else {
+            if (this->error.empty())
+                this->error = error;
+            this->failed = (this->format == QGlCaptureFormat::Pipe);
+        }
+    }
+
+    if (this->pipe != nullptr) {
+        pclose(this->pipe);
+        this->pipe = nullptr;
+    }
+}
+
+
+bool QGlCapture::writeFrame(const QGlCaptureFrame& frame, string& error) {
+    size_t size = frame.pixels.size();
+    if (this->format == QGlCaptureFormat::Pipe) {
+        if (fwrite(frame.pixels.data(), 1, size, this->pipe) != size) {
+            error = string("Capture: the pipe was closed: ") + strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    fs::path path = QGlFrameName(this->target, frame.index);
+    if (this->format == QGlCaptureFormat::PNG)
+        return QGlCapture::writePNG(path, frame.pixels.data(), frame.width, frame.height, error);
+
+    ofstream stream(path, ios::binary | ios::trunc);
+    stream.write((const char*) frame.pixels.data(), size);
+    stream.close();
+    if (!stream) {
+        error = path.string() + ": write failed";
+        return false;
+    }
+    return true;
+}
+
+
+QGlCaptureStats QGlCapture::getStats() {
+    lock_guard<mutex> guard(this->lock);
+    return this->stats;
+}
+
+
+string QGlCapture::getError() {
+    lock_guard<mutex> guard(this->lock);
+    return this->error;
+}
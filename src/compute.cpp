@@ -0,0 +1,362 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    compute.cpp
+//
+// DESCRIPTION:
+// -----------
+// Compute shader utilities: storage buffer and image bindings, dispatches
+// sized from the work group size of the program, and GPU-driven frustum
+// culling that writes indirect draw commands.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/compute.hpp"
+
+
+QGlCompute& QGlCompute::withShader(QGlShader& shader) {
+    this->shader  = &shader;
+    this->program = 0;
+    return *this;
+}
+
+
+/* Queried again whenever the program changes (e.g. when it is hot reloaded). */
+void QGlCompute::updateGroupSize() {
+    GLuint id = (this->shader != nullptr) ? this->shader->getID() : 0;
+    if (id == this->program)
+        return;
+
+    GLint size[3] = { 1, 1, 1 };
+    if (id != 0)
+        glGetProgramiv(id, GL_COMPUTE_WORK_GROUP_SIZE, size);
+    this->program   = id;
+    this->groupSize = { GLuint(size[0]), GLuint(size[1]), GLuint(size[2]) };
+}
+
+
+array<GLuint, 3> QGlCompute::getGroupSize() {
+    this->updateGroupSize();
+    return this->groupSize;
+}
+
+
+QGlCompute& QGlCompute::bindStorage(GLuint index, GLuint buffer) {
+    QGlState::current().bindBufferBase(GL_SHADER_STORAGE_BUFFER, index, buffer);
+    return *this;
+}
+
+
+QGlCompute& QGlCompute::bindStorage(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    QGlState::current().bindBufferRange(GL_SHADER_STORAGE_BUFFER, index, buffer, offset, size);
+    return *this;
+}
+
+
+/* Binds a level of a texture to an image unit (access: GL_READ_ONLY,
+ * GL_WRITE_ONLY or GL_READ_WRITE; format: as declared in the shader, e.g.
+ * GL_RGBA8). Layered textures are bound whole. */
+QGlCompute& QGlCompute::bindImage(GLuint unit, GLuint texture, GLenum access, GLenum format, GLint level) {
+    glBindImageTexture(unit, texture, level, GL_TRUE, 0, access, format);
+    return *this;
+}
+
+
+/* Enough work groups for the given number of invocations in each dimension. */
+void QGlCompute::dispatch(GLuint x, GLuint y, GLuint z, GLbitfield barriers) {
+    this->updateGroupSize();
+    this->dispatchGroups((x + this->groupSize[0] - 1) / this->groupSize[0],
+                         (y + this->groupSize[1] - 1) / this->groupSize[1],
+                         (z + this->groupSize[2] - 1) / this->groupSize[2], barriers);
+}
+
+
+void QGlCompute::dispatchGroups(GLuint x, GLuint y, GLuint z, GLbitfield barriers) {
+    if (this->shader == nullptr || this->shader->getID() == 0 || x == 0 || y == 0 || z == 0)
+        return;
+    this->shader->use();
+    glDispatchCompute(x, y, z);
+    if (barriers != 0)
+        glMemoryBarrier(barriers);
+}
+
+
+/* The number of work groups is read by the GPU from the buffer, at the given
+ * offset (three uints), e.g. as written by a previous dispatch. */
+void QGlCompute::dispatchIndirect(GLuint buffer, GLintptr offset, GLbitfield barriers) {
+    if (this->shader == nullptr || this->shader->getID() == 0)
+        return;
+    this->shader->use();
+    QGlState::current().bindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffer);
+    glDispatchComputeIndirect(offset);
+    if (barriers != 0)
+        glMemoryBarrier(barriers);
+}
+
+
+/* Built-in culling kernel: bounding spheres against the six planes of the
+ * frustum, each visible instance taking the next slot of its mesh's command. */
+static const char* QGL_CULLING_KERNEL = R"(#version 430 core
+layout(local_size_x = 256) in;
+
+struct Command {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int  baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly  buffer Bounds   { vec4    bounds[];   };
+layout(std430, binding = 1) readonly  buffer MeshOf   { uint    meshOf[];   };
+layout(std430, binding = 2)           buffer Commands { Command commands[]; };
+layout(std430, binding = 3) writeonly buffer Visible  { uint    visible[];  };
+
+uniform vec4 planes[6];
+uniform uint instanceCount;
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= instanceCount)
+        return;
+
+    vec4 sphere = bounds[i];
+    for (int p = 0; p < 6; p++)
+        if (dot(planes[p].xyz, sphere.xyz) + planes[p].w < -sphere.w)
+            return;
+
+    uint mesh = meshOf[i];
+    uint slot = atomicAdd(commands[mesh].instanceCount, 1u);
+    visible[commands[mesh].baseInstance + slot] = i;
+}
+)";
+
+
+bool QGlGpuCulling::compileKernel() {
+    GLuint kernel = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(kernel, 1, &QGL_CULLING_KERNEL, nullptr);
+    glCompileShader(kernel);
+
+    GLint success = 0;
+    char  log[1024];
+    glGetShaderiv(kernel, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(kernel, sizeof(log), nullptr, log);
+        this->error = string("Culling kernel: compilation failed: ") + log;
+        glDeleteShader(kernel);
+        return false;
+    }
+
+    this->program = glCreateProgram();
+    glAttachShader(this->program, kernel);
+    glLinkProgram(this->program);
+    glDeleteShader(kernel);
+    glGetProgramiv(this->program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(this->program, sizeof(log), nullptr, log);
+        this->error = string("Culling kernel: linking failed: ") + log;
+        glDeleteProgram(this->program);
+        this->program = 0;
+        return false;
+    }
+
+    this->planesLocation = glGetUniformLocation(this->program, "planes");
+    this->countLocation  = glGetUniformLocation(this->program, "instanceCount");
+    return true;
+}
+
+
+/* Compiles the kernel: false if it fails (see getError()), e.g. before OpenGL 4.3. */
+bool QGlGpuCulling::create() {
+    this->release();
+    if (!this->compileKernel())
+        return false;
+    GLuint* buffers[] = { &this->bounds, &this->meshOf, &this->templates, &this->commands, &this->visible };
+    for (GLuint* buffer : buffers)
+        glGenBuffers(1, buffer);
+    return true;
+}
+
+
+void QGlGpuCulling::release() {
+    QGlState& state = QGlState::current();
+    GLuint* buffers[] = { &this->bounds, &this->meshOf, &this->templates, &this->commands, &this->visible };
+    for (GLuint* buffer : buffers) {
+        if (*buffer != 0) {
+            state.forgetBuffer(*buffer);
+            glDeleteBuffers(1, buffer);
+        }
+        *buffer = 0;
+    }
+    if (this->program != 0) {
+        state.forgetProgram(this->program);
+        glDeleteProgram(this->program);
+    }
+    this->program       = 0;
+    this->instanceCount = 0;
+    this->meshes.clear();
+    this->instancesOf.clear();
+}
+
+
+/* The meshes are drawn with a single multi-draw: they must share the vertex
+ * array, primitive and index type, i.e. be parts of the same buffers. The
+ * instances must be set again afterwards. */
+bool QGlGpuCulling::setMeshes(const vector<QGlMesh>& meshes) {
+    for (const QGlMesh& mesh : meshes)
+        if (mesh.vao != meshes[0].vao || mesh.mode != meshes[0].mode || mesh.indexType != meshes[0].indexType) {
+            this->error = "Culling: meshes do not share the vertex array, primitive and index type";
+            return false;
+        }
+
+    this->meshes = meshes;
+    this->instancesOf.assign(meshes.size(), 0);
+    this->instanceCount = 0;
+    this->uploadTemplates();
+    return true;
+}
+
+
+/* Bounding spheres (center, radius) of the instances, and the mesh of each
+ * (none: all drawn with the first mesh). Uploaded once: use updateBounds()
+ * for the instances that move. */
+bool QGlGpuCulling::setInstances(const vector<glm::vec4>& spheres, const vector<uint32_t>& meshOf) {
+    if (this->program == 0 || this->meshes.empty() || (!meshOf.empty() && meshOf.size() != spheres.size())) {
+        this->error = "Culling: not created, no meshes, or not one mesh per instance";
+        return false;
+    }
+
+    vector<uint32_t> meshes = meshOf.empty() ? vector<uint32_t>(spheres.size(), 0) : meshOf;
+    this->instancesOf.assign(this->meshes.size(), 0);
+    for (uint32_t mesh : meshes) {
+        if (mesh >= this->meshes.size()) {
+            this->error = "Culling: instance of an unknown mesh";
+            return false;
+        }
+        this->instancesOf[mesh]++;
+    }
+    this->instanceCount = spheres.size();
+
+    QGlState& state = QGlState::current();
+    state.bindBuffer(GL_SHADER_STORAGE_BUFFER, this->bounds);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, spheres.size() * sizeof(glm::vec4), spheres.data(), GL_DYNAMIC_DRAW);
+    state.bindBuffer(GL_SHADER_STORAGE_BUFFER, this->meshOf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, meshes.size() * sizeof(uint32_t), meshes.data(), GL_STATIC_DRAW);
+    state.bindBuffer(GL_SHADER_STORAGE_BUFFER, this->visible);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, max<size_t>(spheres.size(), 1) * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+
+    this->uploadTemplates();
+    return true;
+}
+
+
+void QGlGpuCulling::updateBounds(const glm::vec4* spheres, uint32_t count, uint32_t first) {
+    if (this->bounds == 0 || first + count > this->instanceCount)
+        return;
+    QGlState::current().bindBuffer(GL_SHADER_STORAGE_BUFFER, this->bounds);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(glm::vec4), count * sizeof(glm::vec4), spheres);
+}
+
+
+/* One command per mesh, with no instances, and the visible indices of its
+ * instances after those of the previous meshes. */
+void QGlGpuCulling::uploadTemplates() {
+    if (this->program == 0 || this->meshes.empty())
+        return;
+
+    GLuint indexSize = (this->meshes[0].indexType == GL_UNSIGNED_BYTE)  ? 1 :
+                       (this->meshes[0].indexType == GL_UNSIGNED_SHORT) ? 2 : 4;
+    vector<QGlDrawElementsCommand> commands;
+    GLuint first = 0;
+    for (size_t i = 0; i < this->meshes.size(); i++) {
+        const QGlMesh& mesh = this->meshes[i];
+        commands.push_back({ GLuint(mesh.count), 0, GLuint(mesh.indexOffset / indexSize), mesh.baseVertex, first });
+        first += this->instancesOf[i];
+    }
+
+    GLsizeiptr size = commands.size() * sizeof(QGlDrawElementsCommand);
+    QGlState& state = QGlState::current();
+    state.bindBuffer(GL_SHADER_STORAGE_BUFFER, this->templates);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, commands.data(), GL_STATIC_COPY);
+    state.bindBuffer(GL_SHADER_STORAGE_BUFFER, this->commands);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, commands.data(), GL_DYNAMIC_COPY);
+}
+
+
+/* Culls the instances against the frustum of the matrix: the commands are
+ * reset from their templates, and rebuilt by the kernel, entirely on the GPU. */
+void QGlGpuCulling::cull(const glm::mat4& viewProjection) {
+    if (this->program == 0 || this->instanceCount == 0)
+        return;
+
+    QGlState& state = QGlState::current();
+    state.bindBuffer(GL_COPY_READ_BUFFER,  this->templates);
+    state.bindBuffer(GL_COPY_WRITE_BUFFER, this->commands);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                        this->meshes.size() * sizeof(QGlDrawElementsCommand));
+
+    QGlFrustum frustum(viewProjection);
+    state.useProgram(this->program);
+    glUniform4fv(this->planesLocation, 6, &frustum.getPlanes()[0].x);
+    glUniform1ui(this->countLocation, this->instanceCount);
+
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, this->bounds);
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->meshOf);
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, this->commands);
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, this->visible);
+    glDispatchCompute((this->instanceCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+
+void QGlGpuCulling::cull(QGlCamera& camera) {
+    this->cull(camera.getProjectionMatrix() * camera.getViewMatrix());
+}
+
+
+/* Draws the visible instances of every mesh, with the program in use. */
+void QGlGpuCulling::draw() {
+    if (this->program == 0 || this->meshes.empty() || this->instanceCount == 0)
+        return;
+    QGlState& state = QGlState::current();
+    state.bindVertexArray(this->meshes[0].vao);
+    state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, this->commands);
+    glMultiDrawElementsIndirect(this->meshes[0].mode, this->meshes[0].indexType, nullptr, this->meshes.size(), 0);
+}
+
+
+/* Adds the index of the instance to the bound vertex array, as an uint
+ * attribute: instanced attributes start at the base instance of each
+ * command, where the kernel listed the visible instances of its mesh. */
+void QGlGpuCulling::bindVisibleIndices(GLuint location) {
+    QGlState::current().bindBuffer(GL_ARRAY_BUFFER, this->visible);
+    glEnableVertexAttribArray(location);
+    glVertexAttribIPointer(location, 1, GL_UNSIGNED_INT, 0, nullptr);
+    glVertexAttribDivisor(location, 1);
+}
+
+
+/* Number of visible instances after the last culling. It reads the commands
+ * back, waiting for the GPU: for debugging only. */
+uint32_t QGlGpuCulling::getVisibleCount() {
+    if (this->commands == 0 || this->meshes.empty())
+        return 0;
+    vector<QGlDrawElementsCommand> commands(this->meshes.size());
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);     // The kernel wrote them through a storage buffer
+    QGlState::current().bindBuffer(GL_SHADER_STORAGE_BUFFER, this->commands);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, commands.size() * sizeof(QGlDrawElementsCommand), commands.data());
+
+    uint32_t count = 0;
+    for (const QGlDrawElementsCommand& command : commands)
+        count += command.instanceCount;
+    return count;
+}
@@ -0,0 +1,290 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    frustum.cpp
+//
+// DESCRIPTION:
+// -----------
+// View frustum planes, and visibility tests of bounding spheres and boxes,
+// one at a time or in batches (vectorized with SSE/AVX where available).
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/frustum.hpp"
+#include "qgl/simd.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+
+/* Gribb & Hartmann: each plane is a sum or difference of rows of the matrix. */
+QGlFrustum::QGlFrustum(const glm::mat4& m) {
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++)
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+    this->planes[0] = row[3] + row[0];      // Left
+    this->planes[1] = row[3] - row[0];      // Right
+    this->planes[2] = row[3] + row[1];      // Bottom
+    this->planes[3] = row[3] - row[1];      // Top
+    this->planes[4] = row[3] + row[2];      // Near
+    this->planes[5] = row[3] - row[2];      // Far
+    for (glm::vec4& plane : this->planes) {
+        float length = sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+        plane = plane * (1.0f / length);
+    }
+}
+
+
+bool QGlFrustum::testSphere(glm::vec3 center, float radius) const {
+    for (const glm::vec4& p : this->planes)
+        if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+            return false;
+    return true;
+}
+
+
+/* Only the corner furthest along the normal of each plane needs testing. */
+bool QGlFrustum::testBox(glm::vec3 lo, glm::vec3 hi) const {
+    for (const glm::vec4& p : this->planes) {
+        float x = (p.x >= 0.0f) ? hi.x : lo.x;
+        float y = (p.y >= 0.0f) ? hi.y : lo.y;
+        float z = (p.z >= 0.0f) ? hi.z : lo.z;
+        if (p.x * x + p.y * y + p.z * z + p.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+
+/* The batch tests write the indices of the visible volumes without branching:
+ * every index of a group is stored, and the output only advances past the
+ * visible ones, so the output needs room for one group more than the count. */
+static const size_t QGL_CULL_SLACK = 8;
+
+static size_t QGlCullSpheresScalar(const glm::vec4* planes, const QGlSpheres& s, size_t begin, size_t end, uint32_t* out) {
+    size_t n = 0;
+    for (size_t i = begin; i < end; i++) {
+        bool inside = true;
+        for (int p = 0; p < 6; p++)
+            inside &= planes[p].x * s.x[i] + planes[p].y * s.y[i] + planes[p].z * s.z[i] + planes[p].w >= -s.radius[i];
+        out[n] = i;
+        n += inside;
+    }
+    return n;
+}
+
+
+static size_t QGlCullBoxesScalar(const glm::vec4* planes, const QGlBoxes& b, size_t begin, size_t end, uint32_t* out) {
+    size_t n = 0;
+    for (size_t i = begin; i < end; i++) {
+        bool inside = true;
+        for (int p = 0; p < 6; p++)
+            inside &= max(planes[p].x * b.minX[i], planes[p].x * b.maxX[i])
+                    + max(planes[p].y * b.minY[i], planes[p].y * b.maxY[i])
+                    + max(planes[p].z * b.minZ[i], planes[p].z * b.maxZ[i]) + planes[p].w >= 0.0f;
+        out[n] = i;
+        n += inside;
+    }
+    return n;
+}
+
+
+#ifdef QGL_SSE
+
+/* Lanes set in a 4-bit mask, in order, and how many there are. */
+alignas(16) static const uint32_t QGL_COMPACT[16][4] = {
+    {0,0,0,0}, {0,0,0,0}, {1,0,0,0}, {0,1,0,0}, {2,0,0,0}, {0,2,0,0}, {1,2,0,0}, {0,1,2,0},
+    {3,0,0,0}, {0,3,0,0}, {1,3,0,0}, {0,1,3,0}, {2,3,0,0}, {0,2,3,0}, {1,2,3,0}, {0,1,2,3}
+};
+static const uint8_t QGL_POPCOUNT[16] = { 0,1,1,2, 1,2,2,3, 1,2,2,3, 2,3,3,4 };
+
+static inline size_t QGlCompact4(uint32_t* out, uint32_t first, int mask) {
+    __m128i lanes = _mm_load_si128((const __m128i*) QGL_COMPACT[mask]);
+    _mm_storeu_si128((__m128i*) out, _mm_add_epi32(lanes, _mm_set1_epi32(first)));
+    return QGL_POPCOUNT[mask];
+}
+
+
+static size_t QGlCullSpheresSSE(const glm::vec4* planes, const QGlSpheres& s, size_t count, uint32_t* out) {
+    __m128 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; p++) {
+        px[p] = _mm_set1_ps(planes[p].x);
+        py[p] = _mm_set1_ps(planes[p].y);
+        pz[p] = _mm_set1_ps(planes[p].z);
+        pw[p] = _mm_set1_ps(planes[p].w);
+    }
+
+    size_t n = 0, i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(&s.x[i]);
+        __m128 y = _mm_loadu_ps(&s.y[i]);
+        __m128 z = _mm_loadu_ps(&s.z[i]);
+        __m128 r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&s.radius[i]));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+                                  _mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, r));
+        }
+        n += QGlCompact4(out + n, i, _mm_movemask_ps(inside));
+    }
+    return n + QGlCullSpheresScalar(planes, s, i, count, out + n);
+}
+
+
+static inline __m128 QGlFarthest(__m128 normal, const float* lo, const float* hi) {
+    return _mm_max_ps(_mm_mul_ps(normal, _mm_loadu_ps(lo)), _mm_mul_ps(normal, _mm_loadu_ps(hi)));
+}
+
+
+static size_t QGlCullBoxesSSE(const glm::vec4* planes, const QGlBoxes& b, size_t count, uint32_t* out) {
+    size_t n = 0, i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m128 d = _mm_add_ps(_mm_add_ps(QGlFarthest(_mm_set1_ps(planes[p].x), &b.minX[i], &b.maxX[i]),
+                                             QGlFarthest(_mm_set1_ps(planes[p].y), &b.minY[i], &b.maxY[i])),
+                                  _mm_add_ps(QGlFarthest(_mm_set1_ps(planes[p].z), &b.minZ[i], &b.maxZ[i]),
+                                             _mm_set1_ps(planes[p].w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+        }
+        n += QGlCompact4(out + n, i, _mm_movemask_ps(inside));
+    }
+    return n + QGlCullBoxesScalar(planes, b, i, count, out + n);
+}
+
+#endif
+
+
+#ifdef QGL_AVX
+
+QGL_TARGET_AVX
+static inline size_t QGlCompact8(uint32_t* out, uint32_t first, int mask) {
+    size_t n = QGlCompact4(out, first, mask & 0xF);
+    return n + QGlCompact4(out + n, first + 4, mask >> 4);
+}
+
+
+QGL_TARGET_AVX
+static size_t QGlCullSpheresAVX(const glm::vec4* planes, const QGlSpheres& s, size_t count, uint32_t* out) {
+    __m256 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; p++) {
+        px[p] = _mm256_set1_ps(planes[p].x);
+        py[p] = _mm256_set1_ps(planes[p].y);
+        pz[p] = _mm256_set1_ps(planes[p].z);
+        pw[p] = _mm256_set1_ps(planes[p].w);
+    }
+
+    size_t n = 0, i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_loadu_ps(&s.x[i]);
+        __m256 y = _mm256_loadu_ps(&s.y[i]);
+        __m256 z = _mm256_loadu_ps(&s.z[i]);
+        __m256 r = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&s.radius[i]));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)),
+                                     _mm256_add_ps(_mm256_mul_ps(pz[p], z), pw[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, r, _CMP_GE_OQ));
+        }
+        n += QGlCompact8(out + n, i, _mm256_movemask_ps(inside));
+    }
+    return n + QGlCullSpheresScalar(planes, s, i, count, out + n);
+}
+
+
+QGL_TARGET_AVX
+static inline __m256 QGlFarthest8(__m256 normal, const float* lo, const float* hi) {
+    return _mm256_max_ps(_mm256_mul_ps(normal, _mm256_loadu_ps(lo)), _mm256_mul_ps(normal, _mm256_loadu_ps(hi)));
+}
+
+
+QGL_TARGET_AVX
+static size_t QGlCullBoxesAVX(const glm::vec4* planes, const QGlBoxes& b, size_t count, uint32_t* out) {
+    size_t n = 0, i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(QGlFarthest8(_mm256_set1_ps(planes[p].x), &b.minX[i], &b.maxX[i]),
+                                                   QGlFarthest8(_mm256_set1_ps(planes[p].y), &b.minY[i], &b.maxY[i])),
+                                     _mm256_add_ps(QGlFarthest8(_mm256_set1_ps(planes[p].z), &b.minZ[i], &b.maxZ[i]),
+                                                   _mm256_set1_ps(planes[p].w)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        n += QGlCompact8(out + n, i, _mm256_movemask_ps(inside));
+    }
+    return n + QGlCullBoxesScalar(planes, b, i, count, out + n);
+}
+
+
+#endif
+
+
+const char* QGlFrustum::getInstructionSet() {
+#if defined(QGL_AVX)
+    if (qglHasAVX())
+        return "AVX";
+#endif
+#if defined(QGL_SSE)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+
+/* Replaces the contents of visible with the indices of the spheres inside the
+ * frustum, in increasing order, and returns how many there are. */
+size_t QGlFrustum::cullSpheres(const QGlSpheres& spheres, vector<uint32_t>& visible) const {
+    size_t count = spheres.size();
+    visible.resize(count + QGL_CULL_SLACK);
+
+    size_t n;
+#if defined(QGL_AVX)
+    if (qglHasAVX())
+        n = QGlCullSpheresAVX(this->planes, spheres, count, visible.data());
+    else
+#endif
+#if defined(QGL_SSE)
+        n = QGlCullSpheresSSE(this->planes, spheres, count, visible.data());
+#else
+        n = QGlCullSpheresScalar(this->planes, spheres, 0, count, visible.data());
+#endif
+
+    visible.resize(n);
+    return n;
+}
+
+
+/* Same as cullSpheres(), for boxes. */
+size_t QGlFrustum::cullBoxes(const QGlBoxes& boxes, vector<uint32_t>& visible) const {
+    size_t count = boxes.size();
+    visible.resize(count + QGL_CULL_SLACK);
+
+    size_t n;
+#if defined(QGL_AVX)
+    if (qglHasAVX())
+        n = QGlCullBoxesAVX(this->planes, boxes, count, visible.data());
+    else
+#endif
+#if defined(QGL_SSE)
+        n = QGlCullBoxesSSE(this->planes, boxes, count, visible.data());
+#else
+        n = QGlCullBoxesScalar(this->planes, boxes, 0, count, visible.data());
+#endif
+
+    visible.resize(n);
+    return n;
+}
@@ -0,0 +1,140 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    input.cpp
+//
+// DESCRIPTION:
+// -----------
+// Keyboard and mouse button state, updated from window events, with
+// constant-time queries and a table binding actions to keys.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/input.hpp"
+
+
+QGlInput::QGlInput() {
+    this->bind(INPUT_EXIT,     GLFW_KEY_ESCAPE).bind(INPUT_EXIT, GLFW_KEY_Q);
+    this->bind(INPUT_FORWARD,  GLFW_KEY_W);
+    this->bind(INPUT_BACKWARD, GLFW_KEY_S);
+    this->bind(INPUT_LEFT,     GLFW_KEY_A);
+    this->bind(INPUT_RIGHT,    GLFW_KEY_D);
+}
+
+
+void QGlInput::consume() {
+    this->pressedKeys.reset();
+    this->releasedKeys.reset();
+    this->pressedButtons.reset();
+    this->releasedButtons.reset();
+}
+
+
+/* GLFW_REPEAT keeps the key down. Unknown keys are ignored. */
+void QGlInput::setKey(int key, int action) {
+    if (key < 0 || key > GLFW_KEY_LAST)
+        return;
+    bool down = (action != GLFW_RELEASE);
+    if (down && !this->keys[key])
+        this->pressedKeys[key] = true;
+    else if (!down && this->keys[key])
+        this->releasedKeys[key] = true;
+    this->keys[key] = down;
+}
+
+
+void QGlInput::setButton(int button, int action) {
+    if (button < 0 || button > GLFW_MOUSE_BUTTON_LAST)
+        return;
+    bool down = (action != GLFW_RELEASE);
+    if (down && !this->buttons[button])
+        this->pressedButtons[button] = true;
+    else if (!down && this->buttons[button])
+        this->releasedButtons[button] = true;
+    this->buttons[button] = down;
+}
+
+
+bool QGlInput::isDown(int key) const {
+    return key >= 0 && key <= GLFW_KEY_LAST && this->keys[key];
+}
+
+bool QGlInput::wasPressed(int key) const {
+    return key >= 0 && key <= GLFW_KEY_LAST && this->pressedKeys[key];
+}
+
+bool QGlInput::wasReleased(int key) const {
+    return key >= 0 && key <= GLFW_KEY_LAST && this->releasedKeys[key];
+}
+
+
+bool QGlInput::isButtonDown(int button) const {
+    return button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST && this->buttons[button];
+}
+
+bool QGlInput::wasButtonPressed(int button) const {
+    return button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST && this->pressedButtons[button];
+}
+
+bool QGlInput::wasButtonReleased(int button) const {
+    return button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST && this->releasedButtons[button];
+}
+
+
+/* Adds a key to the action, up to MAX_KEYS_PER_ACTION keys (further ones are ignored). */
+QGlInput& QGlInput::bind(unsigned action, int key) {
+    if (action >= this->bindings.size()) {
+        Binding unbound;
+        unbound.fill(-1);
+        this->bindings.resize(action + 1, unbound);
+    }
+    for (int16_t& slot : this->bindings[action]) {
+        if (slot == key)
+            break;
+        if (slot < 0) {
+            slot = key;
+            break;
+        }
+    }
+    return *this;
+}
+
+
+QGlInput& QGlInput::unbind(unsigned action) {
+    if (action < this->bindings.size())
+        this->bindings[action].fill(-1);
+    return *this;
+}
+
+
+template <class F>
+bool QGlInput::anyBound(unsigned action, F test) const {
+    if (action >= this->bindings.size())
+        return false;
+    for (int16_t key : this->bindings[action])
+        if (key >= 0 && test(key))
+            return true;
+    return false;
+}
+
+
+bool QGlInput::isActionDown(unsigned action) const {
+    return this->anyBound(action, [this](int key) { return this->isDown(key); });
+}
+
+bool QGlInput::wasActionPressed(unsigned action) const {
+    return this->anyBound(action, [this](int key) { return this->wasPressed(key); });
+}
+
+bool QGlInput::wasActionReleased(unsigned action) const {
+    return this->anyBound(action, [this](int key) { return this->wasReleased(key); });
+}
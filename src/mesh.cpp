@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    mesh.cpp
+//
+// DESCRIPTION:
+// -----------
+// Static meshes: vertex arrays and buffers created from .qglm files, straight
+// from their mapping.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/mesh.hpp"
+#include "qgl/ringbuffer.hpp"
+#include "qgl/state.hpp"
+
+
+/* Immutable storage where available: the driver may place it for drawing only. */
+static GLuint QGlCreateStaticBuffer(GLenum target, GLsizeiptr size, const void* data) {
+    GLuint id;
+    glGenBuffers(1, &id);
+    QGlState::current().bindBuffer(target, id);
+    if (QGlRingBuffer::isSupported())
+        glBufferStorage(target, size, data, 0);
+    else
+        glBufferData(target, size, data, GL_STATIC_DRAW);
+    return id;
+}
+
+
+bool QGlStaticMesh::load(const fs::path& path) {
+    QGlMeshFile file;
+    if (!file.open(path)) {
+        this->error = file.getError();
+        return false;
+    }
+    return this->upload(file);
+}
+
+
+/* Replaces the mesh. The file may be closed afterwards: OpenGL copies the
+ * blocks before the buffers are created. */
+bool QGlStaticMesh::upload(const QGlMeshFile& file) {
+    this->release();
+    this->header = file.getHeader();
+
+    QGlState& state = QGlState::current();
+    while (glGetError() != GL_NO_ERROR);
+    glGenVertexArrays(1, &this->vao);
+    state.bindVertexArray(this->vao);
+    this->vertexBuffer = QGlCreateStaticBuffer(GL_ARRAY_BUFFER, file.getVertexBytes(), file.getVertices());
+    this->indexBuffer  = QGlCreateStaticBuffer(GL_ELEMENT_ARRAY_BUFFER, file.getIndexBytes(), file.getIndices());
+
+    for (uint32_t i = 0; i < this->header.attributeCount; i++) {
+        const QGlMeshAttribute& attribute = this->header.attributes[i];
+        glEnableVertexAttribArray(attribute.location);
+        if (attribute.integer)
+            glVertexAttribIPointer(attribute.location, attribute.components, attribute.type,
+                                   this->header.vertexStride, (void*) (uintptr_t) attribute.offset);
+        else
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                                  this->header.vertexStride, (void*) (uintptr_t) attribute.offset);
+    }
+    state.bindVertexArray(0);
+
+    GLenum status = glGetError();
+    if (status != GL_NO_ERROR) {
+        this->error = (status == GL_OUT_OF_MEMORY) ? "Out of video memory" : "Invalid mesh layout";
+        this->release();
+        return false;
+    }
+    return true;
+}
+
+
+void QGlStaticMesh::release() {
+    QGlState& state = QGlState::current();
+    if (this->vao != 0) {
+        state.forgetVertexArray(this->vao);
+        glDeleteVertexArrays(1, &this->vao);
+    }
+    for (GLuint* buffer : { &this->vertexBuffer, &this->indexBuffer })
+        if (*buffer != 0) {
+            state.forgetBuffer(*buffer);
+            glDeleteBuffers(1, buffer);
+        }
+    this->vao = this->vertexBuffer = this->indexBuffer = 0;
+}
+
+
+/* The whole mesh, for QGlBatch::submit() and the like. */
+QGlMesh QGlStaticMesh::getMesh() const {
+    QGlMesh mesh;
+    mesh.vao       = this->vao;
+    mesh.mode      = this->header.mode;
+    mesh.count     = this->header.indexCount;
+    mesh.indexType = this->header.indexType;
+    return mesh;
+}
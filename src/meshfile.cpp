@@ -0,0 +1,131 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    meshfile.cpp
+//
+// DESCRIPTION:
+// -----------
+// Reading and writing of the binary mesh format (.qglm). Makes no OpenGL
+// calls, so that offline tools may link it alone.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/mesh.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+
+
+static size_t QGlIndexSize(uint32_t type) {
+    switch (type) {
+        case GL_UNSIGNED_BYTE:  return 1;
+        case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT:   return 4;
+        default:                return 0;
+    }
+}
+
+
+/* True if [offset, offset + count * size) lies within the file. */
+static bool QGlFits(uint64_t offset, uint64_t count, uint64_t size, uint64_t total) {
+    return offset <= total && (size == 0 || count <= (total - offset) / size);
+}
+
+
+/* Maps the file and validates its header; the blocks are not read. */
+bool QGlMeshFile::open(const fs::path& path) {
+    this->close();
+    this->file = QGlSourceFile::open(path, this->error);
+    if (this->file == nullptr)
+        return false;
+
+    string_view bytes = this->file->view();
+    const char* problem = nullptr;
+    if (bytes.size() < sizeof(QGlMeshHeader))
+        problem = "truncated header";
+    else {
+        memcpy(&this->header, bytes.data(), sizeof(QGlMeshHeader));
+        const QGlMeshHeader& h = this->header;
+        if (memcmp(h.magic, "QGLM", 4) != 0)
+            problem = "not a quickGL mesh";
+        else if (h.version != QGL_MESH_VERSION)
+            problem = "unsupported version";
+        else if (h.attributeCount > 8 || h.vertexStride == 0 || QGlIndexSize(h.indexType) == 0)
+            problem = "invalid header";
+        else if (h.vertexCount == 0 || h.indexCount == 0)
+            problem = "no vertices or no indices (meshes must be indexed)";
+        else if (h.vertexOffset % QGL_MESH_ALIGNMENT != 0 || h.indexOffset % QGL_MESH_ALIGNMENT != 0)
+            problem = "misaligned blocks";
+        else if (!QGlFits(h.vertexOffset, h.vertexCount, h.vertexStride, bytes.size())
+              || !QGlFits(h.indexOffset, h.indexCount, QGlIndexSize(h.indexType), bytes.size()))
+            problem = "truncated data";
+    }
+    if (problem != nullptr) {
+        this->error = path.string() + ": " + problem;
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+
+void QGlMeshFile::close() {
+    this->file.reset();
+}
+
+
+const void* QGlMeshFile::getVertices() const {
+    return this->file ? this->file->view().data() + this->header.vertexOffset : nullptr;
+}
+
+
+const void* QGlMeshFile::getIndices() const {
+    return this->file ? this->file->view().data() + this->header.indexOffset : nullptr;
+}
+
+
+size_t QGlMeshFile::getIndexBytes() const {
+    return this->header.indexCount * QGlIndexSize(this->header.indexType);
+}
+
+
+/* Writes a mesh: the counts, stride, attributes, index type, mode and bounds
+ * are taken from the header; the magic, version and offsets are set here. */
+bool QGlMeshFile::write(const fs::path& path, QGlMeshHeader header, const void* vertices, const void* indices, string& error) {
+    auto align = [](uint64_t offset) { return (offset + QGL_MESH_ALIGNMENT - 1) / QGL_MESH_ALIGNMENT * QGL_MESH_ALIGNMENT; };
+
+    uint64_t vertexBytes = header.vertexCount * header.vertexStride;
+    uint64_t indexBytes  = header.indexCount * QGlIndexSize(header.indexType);
+    memcpy(header.magic, "QGLM", 4);
+    header.version      = QGL_MESH_VERSION;
+    header.vertexOffset = align(sizeof(QGlMeshHeader));
+    header.indexOffset  = align(header.vertexOffset + vertexBytes);
+
+    ofstream stream(path, ios::binary | ios::trunc);
+    if (!stream) {
+        error = path.string() + ": " + strerror(errno);
+        return false;
+    }
+    const char padding[QGL_MESH_ALIGNMENT] = {};
+    stream.write((const char*) &header, sizeof(header));
+    stream.write(padding, header.vertexOffset - sizeof(header));
+    stream.write((const char*) vertices, vertexBytes);
+    stream.write(padding, header.indexOffset - header.vertexOffset - vertexBytes);
+    stream.write((const char*) indices, indexBytes);
+    stream.close();
+    if (!stream) {
+        error = path.string() + ": write failed";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,372 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    preprocessor.cpp
+//
+// DESCRIPTION:
+// -----------
+// GLSL source loading: a process-wide cache of memory-mapped source files,
+// and the #include preprocessor built on it.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/preprocessor.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define QGL_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+mutex                                                  QGlSourceCache::lock;
+unordered_map<string, QGlSourceCache::QGlSourceEntry>  QGlSourceCache::entries;
+QGlSourceCacheStats                                    QGlSourceCache::stats;
+
+
+QGlSourceFile::~QGlSourceFile() {
+#ifdef QGL_MMAP
+    if (this->mapped)
+        munmap((void*) this->data, this->size);
+#endif
+}
+
+
+/* Maps the file when possible, which spares the copies of reading it through
+ * a stream; falls back to reading it otherwise. Returns nullptr on failure. */
+shared_ptr<QGlSourceFile> QGlSourceFile::open(const fs::path& path, string& error) {
+    auto file = make_shared<QGlSourceFile>();
+
+#ifdef QGL_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = path.string() + ": " + strerror(errno);
+        return nullptr;
+    }
+    struct stat info;
+    bool empty = false;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        empty = (info.st_size == 0);    // Empty files cannot be mapped
+        void* data = empty ? MAP_FAILED : mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            file->data   = (const char*) data;
+            file->size   = info.st_size;
+            file->mapped = true;
+            madvise(data, info.st_size, MADV_SEQUENTIAL);     // Read once, front to back: read ahead
+        }
+    }
+    ::close(fd);
+    if (file->mapped || empty)
+        return file;
+#endif
+
+    ifstream stream(path, ios::binary);
+    if (!stream) {
+        error = path.string() + ": " + strerror(errno);
+        return nullptr;
+    }
+    file->buffer.assign(istreambuf_iterator<char>(stream), istreambuf_iterator<char>());
+    file->data = file->buffer.data();
+    file->size = file->buffer.size();
+    return file;
+}
+
+
+shared_ptr<const QGlSourceFile> QGlSourceCache::get(const fs::path& path, string& error) {
+    std::error_code ec;
+    string             name  = fs::absolute(path, ec).lexically_normal().string();
+    fs::file_time_type mtime = fs::last_write_time(path, ec);
+    uintmax_t          size  = ec ? 0 : fs::file_size(path, ec);
+    if (ec) {
+        error = path.string() + ": " + ec.message();
+        return nullptr;
+    }
+
+    {
+        lock_guard<mutex> guard(QGlSourceCache::lock);
+        auto it = QGlSourceCache::entries.find(name);
+        if (it != QGlSourceCache::entries.end() && it->second.mtime == mtime && it->second.size == size) {
+            QGlSourceCache::stats.hits++;
+            return it->second.file;
+        }
+    }
+
+    // Read outside of the lock, so that workers load different files concurrently
+    shared_ptr<const QGlSourceFile> file = QGlSourceFile::open(path, error);
+    if (file == nullptr)
+        return nullptr;
+
+    lock_guard<mutex> guard(QGlSourceCache::lock);
+    QGlSourceCache::entries[name] = QGlSourceEntry{ mtime, size, file };
+    QGlSourceCache::stats.reads++;
+    return file;
+}
+
+
+QGlSourceCacheStats QGlSourceCache::getStats() {
+    lock_guard<mutex> guard(QGlSourceCache::lock);
+    return QGlSourceCache::stats;
+}
+
+
+void QGlSourceCache::resetStats() {
+    lock_guard<mutex> guard(QGlSourceCache::lock);
+    QGlSourceCache::stats = QGlSourceCacheStats();
+}
+
+
+/* Files still in use by a preprocessor stay mapped until it is done with them. */
+void QGlSourceCache::clear() {
+    lock_guard<mutex> guard(QGlSourceCache::lock);
+    QGlSourceCache::entries.clear();
+}
+
+
+/* Splits a preprocessor directive line ("  #  include <file>  // comment") in
+ * its name ("include") and arguments ("<file>"), without the comment that may
+ * follow them. False if the line is no directive. */
+static bool QGlDirective(string_view line, string_view& name, string_view& args) {
+    const char* blank = " \t\r\n";
+    size_t start = line.find_first_not_of(blank);
+    if (start == string_view::npos || line[start] != '#')
+        return false;
+    start = line.find_first_not_of(blank, start + 1);
+    if (start == string_view::npos)
+        return false;
+    size_t end = line.find_first_of(blank, start);
+    name = line.substr(start, end == string_view::npos ? string_view::npos : end - start);
+    args = (end == string_view::npos) ? string_view() : line.substr(end);
+
+    bool quoted = false;
+    for (size_t i = 0; i + 1 < args.size(); i++) {
+        if (args[i] == '"')
+            quoted = !quoted;
+        else if (!quoted && args[i] == '/' && (args[i + 1] == '/' || args[i + 1] == '*')) {
+            args = args.substr(0, i);
+            break;
+        }
+    }
+    size_t first = args.find_first_not_of(blank);
+    size_t last  = args.find_last_not_of(blank);
+    args = (first == string_view::npos) ? string_view() : args.substr(first, last - first + 1);
+    return true;
+}
+
+
+/* Tells if a block comment is open at the end of the line, given whether one
+ * was open at its start. */
+static bool QGlBlockComment(string_view line, bool open) {
+    for (size_t i = 0; i < line.size(); ) {
+        if (open) {
+            size_t close = line.find("*/", i);
+            if (close == string_view::npos)
+                return true;
+            open = false;
+            i    = close + 2;
+            continue;
+        }
+        size_t slash = line.find('/', i);
+        if (slash == string_view::npos || slash + 1 >= line.size() || line[slash + 1] == '/')
+            return false;
+        open = (line[slash + 1] == '*');
+        i    = slash + (open ? 2 : 1);
+    }
+    return open;
+}
+
+
+string QGlPreprocessor::key(const fs::path& path) {
+    std::error_code ec;
+    return fs::absolute(path, ec).lexically_normal().string();
+}
+
+
+uint32_t QGlPreprocessor::number(const fs::path& path) {
+    for (size_t i = 0; i < this->includes.size(); i++)
+        if (this->includes[i] == path)
+            return i + 1;
+    this->includes.push_back(path);
+    return this->includes.size();
+}
+
+
+bool QGlPreprocessor::resolve(string_view name, bool quoted, const fs::path& from, fs::path& path) {
+    std::error_code ec;
+    if (fs::path(name).is_absolute()) {
+        path = fs::path(name);
+        return fs::exists(path, ec);
+    }
+    if (quoted) {
+        path = (from.parent_path() / name).lexically_normal();
+        if (fs::exists(path, ec))
+            return true;
+    }
+    path = (this->rootPath / name).lexically_normal();
+    return fs::exists(path, ec);
+}
+
+
+/* Replaces the output with the expanded source of the given file. */
+bool QGlPreprocessor::process(const fs::path& path, string& out) {
+    this->includes.clear();
+    this->stack.clear();
+    this->once.clear();
+    this->error.clear();
+
+    this->versioned    = false;
+    this->preambleAt   = 0;
+    this->preambleLine = 1;
+
+    out.clear();
+    if (!this->expand(path, 0, out))
+        return false;
+
+    string preamble = this->preamble(out);
+    if (!preamble.empty())
+        out.insert(this->preambleAt, preamble);
+    return true;
+}
+
+
+/* Tells if the source mentions the given identifier as a whole word. */
+static bool QGlMentions(string_view code, string_view name) {
+    auto identifier = [](char c) { return isalnum((unsigned char) c) || c == '_'; };
+    for (size_t pos = code.find(name); pos != string_view::npos; pos = code.find(name, pos + 1)) {
+        size_t end = pos + name.size();
+        if ((pos == 0 || !identifier(code[pos - 1])) && (end == code.size() || !identifier(code[end])))
+            return true;
+    }
+    return false;
+}
+
+
+/* Only the defines the expanded source refers to are inserted, so that a stage
+ * that does not depend on a define compiles to the same source with or without
+ * it (and may be shared between programs, see QGlStageCache). */
+string QGlPreprocessor::preamble(const string& code) {
+    string text;
+    for (const string& define : this->defines) {
+        string_view name = string_view(define).substr(0, define.find_first_of(" \t("));
+        if (QGlMentions(code, name))
+            text += "#define " + define + "\n";
+    }
+    if (text.empty())
+        return text;
+    return text + "#line " + to_string(this->preambleLine) + " 0\n";
+}
+
+
+/* Unchanged runs of lines are appended as a whole, straight from the mapped
+ * file: only the directive lines handled here are ever looked at twice. */
+bool QGlPreprocessor::expand(const fs::path& path, uint32_t source, string& out) {
+    string reason;
+    shared_ptr<const QGlSourceFile> file = QGlSourceCache::get(path, reason);
+    if (file == nullptr) {
+        this->error = reason;
+        return false;
+    }
+
+    string name = QGlPreprocessor::key(path);
+    this->stack.push_back(name);
+
+    string_view code = file->view();
+    size_t copied = 0, pos = 0;
+    uint32_t line = 1;
+    bool     comment  = false;      // In a block comment
+    uint32_t disabled = 0;          // Depth of the conditional blocks within an #if 0 block (0: none)
+
+    while (pos < code.size()) {
+        size_t end  = code.find('\n', pos);
+        size_t next = (end == string_view::npos) ? code.size() : end + 1;
+        string_view text = code.substr(pos, next - pos);
+
+        string_view directive, args;
+        bool include = false, pragmaOnce = false, version = false;
+        bool commented = comment;
+        comment = QGlBlockComment(text, comment);
+        if (!commented && QGlDirective(text, directive, args) && disabled > 0) {
+            if (directive == "if" || directive == "ifdef" || directive == "ifndef")
+                disabled++;
+            else if (directive == "endif" || ((directive == "else" || directive == "elif") && disabled == 1))
+                disabled--;
+        } else if (!commented && !directive.empty()) {
+            disabled   = (directive == "if" && args == "0");
+            include    = (directive == "include");
+            pragmaOnce = (directive == "pragma" && args == "once");
+            version    = (directive == "version" && source == 0 && !this->versioned);
+        }
+
+        if (include || pragmaOnce) {
+            out.append(code.substr(copied, pos - copied));
+            copied = next;
+        }
+
+        if (version) {
+            out.append(code.substr(copied, next - copied));
+            if (out.back() != '\n')
+                out += '\n';
+            this->preambleAt   = out.size();
+            this->preambleLine = line + 1;
+            this->versioned    = true;
+            copied = next;
+        } else if (pragmaOnce) {
+            this->once.insert(name);
+            out += '\n';            // Keeps the line count
+        } else if (include) {
+            string where = " (included from " + path.string() + ":" + to_string(line) + ")";
+            bool quoted  = args.size() > 2 && args.front() == '"' && args.back() == '"';
+            bool bracket = args.size() > 2 && args.front() == '<' && args.back() == '>';
+            if (!quoted && !bracket) {
+                this->error = "malformed #include" + where;
+                return false;
+            }
+
+            fs::path target;
+            string_view target_name = args.substr(1, args.size() - 2);
+            if (!this->resolve(target_name, quoted, path, target)) {
+                this->error = string(target_name) + " not found" + where;
+                return false;
+            }
+
+            string target_key = QGlPreprocessor::key(target);
+            for (const string& open : this->stack) {
+                if (open == target_key) {
+                    this->error = "circular #include of " + target.string() + where;
+                    return false;
+                }
+            }
+
+            if (!this->once.contains(target_key)) {
+                out += "#line 1 " + to_string(this->number(target)) + "\n";
+                if (!this->expand(target, this->number(target), out))
+                    return false;
+                if (!out.empty() && out.back() != '\n')
+                    out += '\n';
+            }
+            out += "#line " + to_string(line + 1) + " " + to_string(source) + "\n";
+        }
+
+        pos = next;
+        line++;
+    }
+
+    out.append(code.substr(copied));
+    this->stack.pop_back();
+    return true;
+}
@@ -0,0 +1,264 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    profiler.cpp
+//
+// DESCRIPTION:
+// -----------
+// Per-frame CPU and GPU timing instrumentation, with min/avg/p99 aggregates
+// and export to the Chrome trace_event format (chrome://tracing, Perfetto).
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <cstdio>
+
+
+/* The string as a JSON string literal, quotes included. */
+static string QGlJsonString(string_view str) {
+    string json = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            json += '\\';
+            json += c;
+        } else if ((unsigned char) c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            json += escaped;
+        } else
+            json += c;
+    }
+    return json + '"';
+}
+
+
+QGlProfiler::Scope::Scope(QGlProfiler* profiler, uint32_t track) : profiler(profiler), track(track) {
+    if (profiler != nullptr)
+        this->start = chrono::steady_clock::now();
+}
+
+
+QGlProfiler::Scope::~Scope() {
+    if (this->profiler != nullptr)
+        this->profiler->record(this->track, this->start, chrono::steady_clock::now());
+}
+
+
+/* Small sequential ids read better in trace viewers than native thread ids.
+ * Id 0 is reserved for the GPU timeline. */
+uint32_t QGlProfiler::threadId() {
+    static atomic<uint32_t> counter = 1;
+    thread_local uint32_t id = counter++;
+    return id;
+}
+
+
+QGlProfiler& QGlProfiler::enable(bool enable, bool gpu) {
+    this->enabled    = enable;
+    this->gpuEnabled = enable && gpu;
+    return *this;
+}
+
+
+QGlProfiler& QGlProfiler::withWindow(size_t samples) {
+    lock_guard<mutex> guard(this->lock);
+    this->window = max<size_t>(samples, 1);
+    for (Track& t : this->tracks) {
+        t.samples.assign(this->window, 0.0f);
+        t.next = t.count = 0;
+    }
+    return *this;
+}
+
+
+uint32_t QGlProfiler::track(string_view name) {
+    lock_guard<mutex> guard(this->lock);
+    auto it = this->trackIndex.find(name);
+    if (it != this->trackIndex.end())
+        return it->second;
+
+    uint32_t index = this->tracks.size();
+    this->tracks.push_back({ string(name), vector<float>(this->window, 0.0f) });
+    this->trackIndex.emplace(string(name), index);
+    return index;
+}
+
+
+QGlProfiler::Scope QGlProfiler::scope(string_view name) {
+    if (!this->enabled)
+        return Scope(nullptr, 0);
+    return Scope(this, this->track(name));
+}
+
+
+void QGlProfiler::record(uint32_t track, TimePoint start, TimePoint end) {
+    this->record(track, QGlProfiler::threadId(), start, end);
+}
+
+
+void QGlProfiler::record(uint32_t track, uint32_t thread, TimePoint start, TimePoint end) {
+    const float ms = chrono::duration<float, milli>(end - start).count();
+
+    lock_guard<mutex> guard(this->lock);
+    if (track >= this->tracks.size())
+        return;
+    Track& t = this->tracks[track];
+    t.samples[t.next] = ms;
+    t.next = (t.next + 1) % t.samples.size();
+    t.count = min(t.count + 1, t.samples.size());
+
+    if (this->tracing && this->trace.size() < this->traceCapacity) {
+        double begin = chrono::duration<double, micro>(start - this->epoch).count();
+        this->trace.push_back({ track, thread, begin, ms * 1000.0 });
+    }
+}
+
+
+void QGlProfiler::beginFrame() {
+    if (!this->enabled)
+        return;
+    this->frameStart = chrono::steady_clock::now();
+
+    if (!this->gpuEnabled)
+        return;
+    if (this->gpuQueries[0] == 0)
+        glGenQueries(GPU_QUERIES, this->gpuQueries);
+
+    // Oldest first, stopping at the first result not available yet
+    for (uint32_t i = 0; i < GPU_QUERIES && this->collectGpu((this->gpuFrame + i) % GPU_QUERIES); i++);
+
+    uint32_t slot = this->gpuFrame % GPU_QUERIES;
+    this->gpuPending[slot] = false;     // Still not available after the whole ring: dropped
+    glBeginQuery(GL_TIME_ELAPSED, this->gpuQueries[slot]);
+    this->gpuStart[slot] = this->frameStart;
+}
+
+
+void QGlProfiler::endFrame() {
+    if (!this->enabled)
+        return;
+    this->record(this->track("frame"), this->frameStart, chrono::steady_clock::now());
+
+    if (!this->gpuEnabled || this->gpuQueries[0] == 0)
+        return;
+    uint32_t slot = this->gpuFrame % GPU_QUERIES;
+    glEndQuery(GL_TIME_ELAPSED);
+    this->gpuPending[slot] = true;
+    this->gpuFrame++;
+}
+
+
+/* Never waits for the GPU: false if the result is not available yet. */
+bool QGlProfiler::collectGpu(uint32_t slot) {
+    if (!this->gpuPending[slot])
+        return true;
+
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(this->gpuQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return false;
+    this->gpuPending[slot] = false;
+
+    GLuint64 elapsed;
+    glGetQueryObjectui64v(this->gpuQueries[slot], GL_QUERY_RESULT, &elapsed);
+    TimePoint start = this->gpuStart[slot];
+    TimePoint end   = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::nanoseconds(elapsed));
+
+    this->record(this->track("gpu"), GPU_THREAD, start, end);
+    return true;
+}
+
+
+QGlTimingStats QGlProfiler::getStats(string_view name) {
+    lock_guard<mutex> guard(this->lock);
+    QGlTimingStats stats;
+    auto it = this->trackIndex.find(name);
+    if (it == this->trackIndex.end())
+        return stats;
+
+    const Track& t = this->tracks[it->second];
+    if (t.count == 0)
+        return stats;
+
+    vector<float> sorted(t.samples.begin(), t.samples.begin() + t.count);
+
+    float sum = 0.0f;
+    for (float ms : sorted)
+        sum += ms;
+
+    size_t p99 = min(sorted.size() - 1, (size_t) (sorted.size() * 0.99f));
+    nth_element(sorted.begin(), sorted.begin() + p99, sorted.end());
+
+    stats.p99     = sorted[p99];
+    stats.min     = *min_element(sorted.begin(), sorted.end());
+    stats.avg     = sum / sorted.size();
+    stats.last    = t.samples[(t.next + t.samples.size() - 1) % t.samples.size()];
+    stats.samples = t.count;
+    return stats;
+}
+
+
+vector<string> QGlProfiler::getScopes() {
+    lock_guard<mutex> guard(this->lock);
+    vector<string> names;
+    for (const Track& t : this->tracks)
+        names.push_back(t.name);
+    return names;
+}
+
+
+void QGlProfiler::startTrace(size_t capacity) {
+    lock_guard<mutex> guard(this->lock);
+    this->trace.clear();
+    this->trace.reserve(capacity);
+    this->traceCapacity = capacity;
+    this->tracing = true;
+}
+
+
+void QGlProfiler::stopTrace() {
+    lock_guard<mutex> guard(this->lock);
+    this->tracing = false;
+}
+
+
+/* Writes the recorded events in the Chrome trace_event JSON format. */
+bool QGlProfiler::dumpTrace(const fs::path& path) {
+    lock_guard<mutex> guard(this->lock);
+    ofstream file(path);
+    if (!file)
+        return false;
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_THREAD << ",\"args\":{\"name\":\"GPU\"}}";
+    for (const TraceEvent& e : this->trace) {
+        file << ",\n{\"name\":" << QGlJsonString(this->tracks[e.track].name)
+             << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+             << ",\"ts\":" << fixed << e.start
+             << ",\"dur\":" << e.duration << "}";
+    }
+    file << "\n]}\n";
+    return (bool) file;
+}
+
+
+/* Must be called while the context that owns the queries is still current. */
+void QGlProfiler::release() {
+    if (this->gpuQueries[0] != 0)
+        glDeleteQueries(GPU_QUERIES, this->gpuQueries);
+    fill(begin(this->gpuQueries), end(this->gpuQueries), 0);
+    fill(begin(this->gpuPending), end(this->gpuPending), false);
+}
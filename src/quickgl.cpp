@@ -22,37 +22,106 @@
 #include "quickgl.hpp"
 #include <iostream>
 #include <cstring>
+#include <cmath>
+#include <thread>
 
 using namespace qgl;
 
+
+/* GLFW and EGL are initialized by the first scene and terminated by the last one. */
+static mutex    libraryLock;
+static unsigned glfwUsers = 0;
+static unsigned eglUsers  = 0;
+
 namespace qgl::callback {
     QGlScene *scene;
 
+    /* Only used by getInstance() without arguments, for backward compatibility */
     void bindInstance(QGlScene *scn) {
         scene = scn;
     }
 
+    /* Scene whose context is current in this thread or, failing that, the last scene initialized. */
     QGlScene* getInstance() {
+        GLFWwindow* window = glfwGetCurrentContext();
+        if (window != nullptr && glfwGetWindowUserPointer(window) != nullptr)
+            return getInstance(window);
         return scene;
     }
 
-    void QGlDefaultCallback_Mouse(GLFWwindow* window, double xpos, double ypos) {
-        if (getInstance()->getMouseData().first) {
-            getInstance()->setMouseData(xpos, ypos, false);
+    QGlScene* getInstance(GLFWwindow* window) {
+        return static_cast<QGlScene*>(glfwGetWindowUserPointer(window));
+    }
+
+    void QGlDefaultHandler_CursorPosition(QGlScene& scn, const QGlEvent& event) {
+        if (scn.withMouseData().first) {
+            scn.setMouseData(event.cursor.x, event.cursor.y, false);
         }
 
-        float xoffset = xpos - getInstance()->getMouseData().lastX;
-        float yoffset = getInstance()->getMouseData().lastY - ypos;     // reversed since y-coordinates go from bottom to top
-        getInstance()->setMouseData(xpos, ypos, false);
-        getInstance()->withCamera().processMouseMovement(xoffset, yoffset);
+        float xoffset = event.cursor.x - scn.withMouseData().lastX;
+        float yoffset = scn.withMouseData().lastY - event.cursor.y;     // reversed since y-coordinates go from bottom to top
+        scn.setMouseData(event.cursor.x, event.cursor.y, false);
+        scn.withCamera().processMouseMovement(xoffset, yoffset);
+    }
+
+    void QGlDefaultHandler_FramebufferSize(QGlScene& scn, const QGlEvent& event) {
+        // With a render thread, the context is not current here: the render thread resizes the viewport
+        if (scn.getWindow() == nullptr || glfwGetCurrentContext() == scn.getWindow())
+            scn.withState().setViewport(0, 0, event.framebuffer.width, event.framebuffer.height);
+        if (event.framebuffer.height > 0)
+            scn.withCamera().withAspectRatio((float) event.framebuffer.width / event.framebuffer.height);
+    }
+
+    void QGlDefaultHandler_Scroll(QGlScene& scn, const QGlEvent& event) {
+        scn.withCamera().processMouseScroll(event.scroll.yoffset);
+    }
+
+    void QGlDefaultCallback_Mouse(GLFWwindow* window, double xpos, double ypos) {
+        QGlEvent event { QGlEventType::CursorPosition };
+        event.cursor = { xpos, ypos };
+        QGlDefaultHandler_CursorPosition(*getInstance(window), event);
     }
 
     void QGlDefaultCallback_FramebufferSize(GLFWwindow* window, int width, int height) {
-        glViewport(0, 0, width, height);
+        QGlEvent event { QGlEventType::FramebufferSize };
+        event.framebuffer = { width, height };
+        QGlDefaultHandler_FramebufferSize(*getInstance(window), event);
     }
 
     void QGlDefaultCallback_Scroll(GLFWwindow* window, double xoffset, double yoffset) {
-        getInstance()->withCamera().processMouseScroll(yoffset);
+        QGlEvent event { QGlEventType::Scroll };
+        event.scroll = { xoffset, yoffset };
+        QGlDefaultHandler_Scroll(*getInstance(window), event);
+    }
+
+    void QGlEventCallback_FramebufferSize(GLFWwindow* window, int width, int height) {
+        QGlEvent event { QGlEventType::FramebufferSize };
+        event.framebuffer = { width, height };
+        getInstance(window)->pushEvent(event);
+    }
+
+    void QGlEventCallback_MouseButton(GLFWwindow* window, int button, int action, int mods) {
+        QGlEvent event { QGlEventType::MouseButton };
+        event.mouseButton = { button, action, mods };
+        getInstance(window)->pushEvent(event);
+    }
+
+    void QGlEventCallback_CursorPosition(GLFWwindow* window, double xpos, double ypos) {
+        QGlEvent event { QGlEventType::CursorPosition };
+        event.cursor = { xpos, ypos };
+        getInstance(window)->pushEvent(event);
+    }
+
+    void QGlEventCallback_Scroll(GLFWwindow* window, double xoffset, double yoffset) {
+        QGlEvent event { QGlEventType::Scroll };
+        event.scroll = { xoffset, yoffset };
+        getInstance(window)->pushEvent(event);
+    }
+
+    void QGlEventCallback_Key(GLFWwindow* window, int key, int scancode, int action, int mods) {
+        QGlEvent event { QGlEventType::Key };
+        event.key = { key, scancode, action, mods };
+        getInstance(window)->pushEvent(event);
     }
 }
 
@@ -62,17 +131,17 @@ const char* QGLException::what() const throw () { return message.c_str(); }
 
 QGlAction QGlScene::QGlDefaultMethod_ProcessInput() {
     // Escape key to exit application
-    if (glfwGetKey(this->window, GLFW_KEY_ESCAPE) == GLFW_PRESS || glfwGetKey(this->window, GLFW_KEY_Q) == GLFW_PRESS)
-        glfwSetWindowShouldClose(this->window, true);
+    if (this->input.isActionDown(INPUT_EXIT))
+        this->close();
 
     // WASD keys to move around
-    if (glfwGetKey(this->window, GLFW_KEY_W) == GLFW_PRESS)
+    if (this->input.isActionDown(INPUT_FORWARD))
         this->camera.processKeyboard(FORWARD, this->deltaTime);
-    if (glfwGetKey(this->window, GLFW_KEY_S) == GLFW_PRESS)
+    if (this->input.isActionDown(INPUT_BACKWARD))
         this->camera.processKeyboard(BACKWARD, this->deltaTime);
-    if (glfwGetKey(this->window, GLFW_KEY_A) == GLFW_PRESS)
+    if (this->input.isActionDown(INPUT_LEFT))
         this->camera.processKeyboard(LEFT, this->deltaTime);
-    if (glfwGetKey(this->window, GLFW_KEY_D) == GLFW_PRESS)
+    if (this->input.isActionDown(INPUT_RIGHT))
         this->camera.processKeyboard(RIGHT, this->deltaTime);
 
     return QGlAction::NO_ACTION;
@@ -80,12 +149,56 @@ QGlAction QGlScene::QGlDefaultMethod_ProcessInput() {
 
 
 QGlScene::QGlScene(const char* argv0) {
+    this->registerDefaultHandlers();
     this->path.call = fs::path(strncmp("./", argv0, 2) == 0 ? &argv0[2] : argv0);
     this->path.curr = fs::path(fs::current_path());
     this->path.full = this->path.curr / fs::path(this->path.call).remove_filename();
 }
 
 
+/* Same behaviour as the default GLFW callbacks of previous versions. */
+void QGlScene::registerDefaultHandlers() {
+    this->on(QGlEventType::FramebufferSize, callback::QGlDefaultHandler_FramebufferSize);
+    this->on(QGlEventType::CursorPosition,  callback::QGlDefaultHandler_CursorPosition);
+    this->on(QGlEventType::Scroll,          callback::QGlDefaultHandler_Scroll);
+}
+
+
+/* Handlers are called in registration order, after the default ones, from
+ * the thread calling run(), once per frame. */
+QGlScene& QGlScene::on(QGlEventType type, QGlEventHandler handler) {
+    this->handlers[(size_t) type].push_back(std::move(handler));
+    return *this;
+}
+
+
+/* Also removes the default handlers (e.g. to stop the mouse from moving the camera). */
+QGlScene& QGlScene::clearHandlers(QGlEventType type) {
+    this->handlers[(size_t) type].clear();
+    return *this;
+}
+
+
+void QGlScene::pushEvent(const QGlEvent& event) {
+    this->events.push(event);
+}
+
+
+/* Also keeps the key and mouse button state up to date, whatever the handlers. */
+void QGlScene::dispatchEvents() {
+    QGlEvent event;
+    while (this->events.pop(event)) {
+        if (event.type == QGlEventType::Key)
+            this->input.setKey(event.key.key, event.key.action);
+        else if (event.type == QGlEventType::MouseButton)
+            this->input.setButton(event.mouseButton.button, event.mouseButton.action);
+
+        for (QGlEventHandler& handler : this->handlers[(size_t) event.type])
+            handler(*this, event);
+    }
+}
+
+
 GLFWwindow* QGlScene::getWindow() {
     return this->window;
 }
@@ -106,15 +219,259 @@ void QGlScene::setMouseData(float x, float y, bool first) {
 
 
 QGlShader& QGlScene::withProgram(string name) {
-    if (!this->programs.contains(name)) {
-        this->programs[name] = QGlShader(this->path.full.c_str());
+    if (!this->programs->contains(name)) {
+        (*this->programs)[name] = QGlShader(this->path.full.c_str());
+        (*this->programs)[name].withStageCache(this->stages);
+    }
+    return (*this->programs)[name];
+}
+
+
+QGlShaderVariants& QGlScene::withVariants(string name) {
+    if (!this->variants->contains(name)) {
+        (*this->variants)[name] = QGlShaderVariants(this->path.full.c_str());
+        (*this->variants)[name].withStageCache(this->stages);
+    }
+    return (*this->variants)[name];
+}
+
+
+/* Buffer of the named uniform block, created on first use from the layout of
+ * a built program that declares it. All programs of the scene are bound to it. */
+QGlUniformBuffer& QGlScene::withUniformBuffer(const string& block) {
+    auto it = this->uniformBuffers->find(block);
+    if (it != this->uniformBuffers->end())
+        return it->second;
+
+    QGlUniformBuffer buffer;
+    bool created = false;
+    for (auto& [name, program] : *this->programs) {
+        if (program.getID() != 0 && buffer.create(program.getID(), block)) {
+            created = true;
+            break;
+        }
+        if (!buffer.getError().empty())
+            throw QGLException(buffer.getError());
+    }
+    if (!created)
+        throw QGLException("No built program declares the uniform block " + block + ".");
+
+    for (auto& [name, program] : *this->programs)
+        program.bindUniformBlocks();
+    for (auto& [name, set] : *this->variants)
+        set.bindUniformBlocks();
+    return this->uniformBuffers->emplace(block, std::move(buffer)).first->second;
+}
+
+
+/* Uploads what changed in the uniform buffers since the last upload. Called
+ * before each refresh; call it again after writing to them within refresh. */
+void QGlScene::uploadUniformBuffers() {
+    for (auto& [name, buffer] : *this->uniformBuffers) {
+        buffer.upload();
+        buffer.bind();
+    }
+}
+
+
+/* Called on finalize, with the context current: the buffers are deleted only
+ * by the last of the scenes sharing them, the others letting go of them. */
+void QGlScene::releaseUniformBuffers() {
+    if (this->uniformBuffers.use_count() > 1) {
+        this->uniformBuffers = make_shared<QGlUniformBuffers>();
+        return;
+    }
+    for (auto& [name, buffer] : *this->uniformBuffers)
+        buffer.release();
+}
+
+
+/* Finishes the variants being warmed in the background, without waiting. */
+void QGlScene::updateVariants() {
+    for (auto& [name, set] : *this->variants)
+        set.update();
+}
+
+
+/* Builds every registered program at once: sources are read on the worker
+ * pool, every program is submitted to the driver, and only then are their
+ * results checked. Check each program's report for the ones that failed. */
+bool QGlScene::buildPrograms() {
+    this->enableParallelCompile();
+
+    vector<QGlShader*>   pending;
+    vector<future<bool>> reads;
+    for (auto& [name, program] : *this->programs) {
+        QGlShader* shader = &program;
+        reads.push_back(QGlThreadPool::shared().submit([shader]() { return shader->readShaders(); }));
+        pending.push_back(shader);
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (reads[i].get())
+            success = pending[i]->submit() && success;
+        else {
+            success = false;
+            pending[i] = nullptr;
+        }
+    }
+
+    for (QGlShader* shader : pending)
+        if (shader != nullptr)
+            success = shader->finish() && success;
+
+    return success;
+}
+
+
+/* Opt-in: watches the files of every program and, when one changes, rebuilds
+ * the program without stalling the frame. The sources are read on a worker
+ * thread, then compiled in parallel by the driver if supported, and the new
+ * program replaces the current one only if it is built successfully. */
+QGlScene& QGlScene::withHotReload(bool enable) {
+    this->hotReload = enable;
+    if (enable)
+        this->watchPrograms();
+    return *this;
+}
+
+
+/* Report of the last failed reload of a program (successful if none failed). */
+QGlShaderReport QGlScene::getReloadReport(const string& name) {
+    auto it = this->reloadReports.find(name);
+    return (it == this->reloadReports.end()) ? QGlShaderReport() : it->second;
+}
+
+
+void QGlScene::watchPrograms() {
+    this->watchedPaths.clear();
+    for (auto& [name, program] : *this->programs) {
+        for (const fs::path& path : program.getPaths()) {
+            this->watcher.watch(path);
+            this->watchedPaths[fs::absolute(path).lexically_normal().string()].push_back(name);
+        }
+    }
+    this->watchedPrograms = this->programs->size();
+}
+
+
+void QGlScene::scheduleReload(const string& name) {
+    for (QGlReload& reload : this->reloads) {
+        if (reload.name == name) {
+            reload.again = true;
+            return;
+        }
+    }
+
+    QGlShader shader = (*this->programs)[name].clone();
+    QGlReload reload;
+    reload.name    = name;
+    reload.sources = QGlThreadPool::shared().submit([shader]() mutable {
+        shader.readShaders();
+        return shader;
+    });
+    this->reloads.push_back(std::move(reload));
+}
+
+
+/* Called once per frame by the thread owning the context. Never waits. */
+void QGlScene::updateHotReload() {
+    if (!this->hotReload)
+        return;
+    this->enableParallelCompile();      // Else finish() would block on the driver
+    if (this->programs->size() != this->watchedPrograms)
+        this->watchPrograms();
+
+    for (const fs::path& file : this->watcher.poll()) {
+        auto it = this->watchedPaths.find(file.string());
+        if (it != this->watchedPaths.end())
+            for (const string& name : it->second)
+                this->scheduleReload(name);
+    }
+
+    vector<string> again;
+    for (auto it = this->reloads.begin(); it != this->reloads.end(); ) {
+        QGlReload& reload = *it;
+
+        if (!reload.submitted) {
+            if (reload.sources.wait_for(chrono::seconds(0)) != future_status::ready) {
+                ++it;
+                continue;
+            }
+            reload.staged = reload.sources.get();
+            reload.submitted = reload.staged.wasSuccessful() && reload.staged.submit();
+        }
+
+        if (reload.submitted && !reload.staged.isReady()) {
+            ++it;
+            continue;
+        }
+
+        if (reload.submitted && reload.staged.finish()) {
+            QGlShader& current = (*this->programs)[reload.name];
+            current.release();
+            current = std::move(reload.staged);
+            this->reloadReports.erase(reload.name);
+            this->watchedPrograms = 0;      // Its includes may have changed
+        } else {
+            this->reloadReports[reload.name] = reload.staged.getReportHandler();
+            reload.staged.release();
+        }
+
+        if (reload.again)
+            again.push_back(reload.name);
+        it = this->reloads.erase(it);
+    }
+
+    for (const string& name : again)
+        this->scheduleReload(name);
+}
+
+
+bool QGlScene::hasExtension(const string& name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* ext = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if (ext != nullptr && name == ext)
+            return true;
+    }
+    return false;
+}
+
+
+/* Lets the driver use as many compiler threads as it wishes. The setting
+ * belongs to the context, which must be current. */
+void QGlScene::enableParallelCompile() {
+    typedef void (*MaxShaderCompilerThreadsProc)(GLuint);
+
+    if (this->parallelCompileQueried)
+        return;
+    this->parallelCompileQueried = true;
+
+    MaxShaderCompilerThreadsProc maxThreads = nullptr;
+    if (this->hasExtension("GL_KHR_parallel_shader_compile"))
+        maxThreads = (MaxShaderCompilerThreadsProc) this->getProcAddress("glMaxShaderCompilerThreadsKHR");
+    else if (this->hasExtension("GL_ARB_parallel_shader_compile"))
+        maxThreads = (MaxShaderCompilerThreadsProc) this->getProcAddress("glMaxShaderCompilerThreadsARB");
+
+    if (maxThreads != nullptr) {
+        maxThreads(0xFFFFFFFF);
+        this->state.setParallelCompile(true);
     }
-    return this->programs[name];
 }
 
 
 bool QGlScene::init_glfw() {
-    glfwInit();
+    {
+        lock_guard<mutex> guard(libraryLock);
+        if (glfwUsers == 0 && !glfwInit())
+            return false;
+        glfwUsers++;
+        this->glfwAcquired = true;
+    }
+
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -123,16 +480,20 @@ bool QGlScene::init_glfw() {
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    this->window = glfwCreateWindow(this->scr_width, this->scr_height, this->scr_title.c_str(), NULL, NULL);
+    GLFWwindow* share = (this->sharedWith != nullptr) ? this->sharedWith->window : NULL;
+    this->window = glfwCreateWindow(this->scr_width, this->scr_height, this->scr_title.c_str(), NULL, share);
     if (this->window == NULL)
         return false;
 
-    glfwMakeContextCurrent(this->window);
+    this->makeContextCurrent(true);
+    glfwSetWindowUserPointer(this->window, this);
+    callback::bindInstance(this);
 
     this->attachFrameBufferSizeCallback();
     this->attachMouseButtonCallback();
     this->attachCursorPositionCallback();
     this->attachScrollCallback();
+    this->attachKeyCallback();
 
     // glfwSetInputMode(this->window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
 
@@ -140,8 +501,104 @@ bool QGlScene::init_glfw() {
 }
 
 
+/* Creates an OpenGL 4.2 core context without any window system, through the
+ * EGL surfaceless platform (e.g. Mesa's llvmpipe on a machine without GPU). */
+bool QGlScene::init_egl() {
+#ifdef QGL_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext share   = EGL_NO_CONTEXT;
+    if (this->sharedWith != nullptr) {
+        if (!this->sharedWith->headless)
+            return false;   // Can not share between EGL and GLFW contexts
+        display = this->sharedWith->egl_display;
+        share   = this->sharedWith->egl_context;
+    } else {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay != nullptr)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    {
+        lock_guard<mutex> guard(libraryLock);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+            return false;
+        eglUsers++;
+    }
+    this->egl_display = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+        return false;
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint    configCount;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0)
+        return false;
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION,       4,
+        EGL_CONTEXT_MINOR_VERSION,       2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, share, contextAttribs);
+    if (context == EGL_NO_CONTEXT)
+        return false;
+    this->egl_context = context;
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        return false;
+    QGlState::makeCurrent(&this->state);
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+/* Headless contexts have no default framebuffer: render into an FBO instead. */
+void QGlScene::init_framebuffer() {
+    glGenRenderbuffers(1, &this->fbo_color);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->fbo_color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, this->scr_width, this->scr_height);
+
+    glGenRenderbuffers(1, &this->fbo_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->fbo_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, this->scr_width, this->scr_height);
+
+    glGenFramebuffers(1, &this->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->fbo_color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->fbo_depth);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw QGLException("Failed to create off-screen framebuffer.");
+
+    this->state.setViewport(0, 0, this->scr_width, this->scr_height);
+}
+
+
+void* QGlScene::getProcAddress(const char* name) {
+#ifdef QGL_EGL
+    if (this->headless)
+        return (void*) eglGetProcAddress(name);
+#endif
+    return (void*) glfwGetProcAddress(name);
+}
+
+
 #ifdef QGL_GLAD
 int QGlScene::init_glad() {
+#ifdef QGL_EGL
+    if (this->headless)
+        return gladLoadGLLoader((GLADloadproc)eglGetProcAddress);
+#endif
     return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
 }
 #endif
@@ -161,6 +618,8 @@ void QGlScene::initialize(const unsigned width, const unsigned height, string ti
     try {
         this->scr_height = height;
         this->scr_width  = width;
+        if (height > 0)
+            this->camera.withAspectRatio((float) width / height);
         this->scr_title  = title;
 
         if (!this->init_glfw())
@@ -180,25 +639,441 @@ void QGlScene::initialize(const unsigned width, const unsigned height, string ti
 }
 
 
+void QGlScene::initializeHeadless(const unsigned width, const unsigned height) {
+    try {
+        this->scr_height = height;
+        this->scr_width  = width;
+        if (height > 0)
+            this->camera.withAspectRatio((float) width / height);
+        this->scr_title  = DEFAULT_SCR_TITLE;
+        this->headless   = true;
+
+        #ifndef QGL_EGL
+        throw QGLException("Headless mode requires quickGL to be compiled with QGL_EGL.");
+        #endif
+
+        if (!this->init_egl())
+            throw QGLException("Failed to create headless EGL context.");
+
+        #ifdef QGL_GLAD
+        if (!this->init_glad())
+            throw QGLException("Failed to initialize GLAD.");
+        #endif
+
+        this->init_framebuffer();
+
+        this->success = true;
+    } catch (QGLException &e) {
+        std::cerr << "QuickGL Error: " << e.what() << std::endl;
+        std::cerr << "QuickGL is aborting launch." << std::endl;
+        this->success = false;
+    }
+}
+
+
 bool QGlScene::launchSuccessful() {
     return this->success;
 }
 
 
+bool QGlScene::shouldClose() {
+    if (!this->headless && this->window == nullptr)     // Finalized
+        return true;
+    if (this->maxFrames > 0 && this->frameCount >= this->maxFrames)
+        return true;
+    if (this->headless)
+        return this->closing;
+    return glfwWindowShouldClose(this->window);
+}
+
+
+void QGlScene::close() {
+    if (this->headless)
+        this->closing = true;
+    else
+        glfwSetWindowShouldClose(this->window, true);
+}
+
+
+/* Seconds since the scene was created. Unlike glfwGetTime(), also available in headless mode. */
+float QGlScene::getTime() {
+    return chrono::duration<float>(chrono::steady_clock::now() - this->epoch).count();
+}
+
+
+/* Runs processInput() at the given rate (in Hz) regardless of the frame rate.
+ * No more than maxSteps ticks are run per frame: the remaining backlog is
+ * dropped, so that a slow frame can not snowball into slower ones.
+ * A rate of 0 restores the default of one processInput() per frame. */
+QGlScene& QGlScene::withFixedTimestep(float hz, unsigned maxSteps) {
+    this->fixedStep   = (hz > 0.0f) ? 1.0f / hz : 0.0f;
+    this->maxSteps    = max(maxSteps, 1u);
+    this->accumulator = 0.0f;
+    this->alpha       = 1.0f;
+    return *this;
+}
+
+
+/* Caps the frame rate (in Hz) without burning a whole core. 0: no limit. */
+QGlScene& QGlScene::withFrameRateLimit(float fps) {
+    if (fps > 0.0f)
+        this->framePeriod = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(1.0 / fps));
+    else
+        this->framePeriod = chrono::steady_clock::duration::zero();
+    this->nextFrame = chrono::steady_clock::now();
+    return *this;
+}
+
+
+/* Opt-in: renders on a dedicated thread, while the calling thread keeps
+ * handling events and input. Inside refresh(), withCamera(), getDeltaTime() and
+ * getAlpha() return the values of the latest frame state (see getFrameState()),
+ * and changes made to the camera are not kept. Must be set before run(). */
+QGlScene& QGlScene::withRenderThread(bool threaded) {
+    this->renderThreaded = threaded;
+    return *this;
+}
+
+
+QGlCamera& QGlScene::withCamera() {
+    if (this->onRenderThread())
+        return this->renderState.camera;
+    return this->camera;
+}
+
+
+float QGlScene::getDeltaTime() {
+    return this->onRenderThread() ? this->renderState.deltaTime : this->deltaTime;
+}
+
+
+float QGlScene::getAlpha() {
+    return this->onRenderThread() ? this->renderState.alpha : this->alpha;
+}
+
+
+/* A copy: the snapshot being rendered on the render thread, or one of the
+ * current values elsewhere, since the render thread replaces its snapshot
+ * while other threads run. */
+QGlFrameState QGlScene::getFrameState() {
+    if (this->onRenderThread())
+        return this->renderState;
+    QGlFrameState state;
+    this->captureFrameState(state);
+    return state;
+}
+
+
 void QGlScene::run() {
-    while (!glfwWindowShouldClose(this->getWindow())) {
-        callback::bindInstance(this);
+    this->lastFrame = this->getTime();
+    this->nextFrame = chrono::steady_clock::now();
+    if (this->renderThreaded) {
+        this->runThreaded();
+        return;
+    }
+    while (!this->shouldClose())
+        this->runFrame();
+}
+
+
+void QGlScene::captureFrameState(QGlFrameState& state) {
+    state.camera    = this->camera;
+    state.mouse     = this->mouse;
+    state.deltaTime = this->deltaTime;
+    state.alpha     = this->alpha;
+    state.frame     = this->inputSteps;
+    if (this->headless) {
+        state.width  = this->scr_width;
+        state.height = this->scr_height;
+    } else
+        glfwGetFramebufferSize(this->window, &state.width, &state.height);
+}
+
+
+void QGlScene::makeContextCurrent(bool current) {
+    QGlState::makeCurrent(current ? &this->state : nullptr);
+#ifdef QGL_EGL
+    if (this->headless) {
+        eglMakeCurrent(this->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, current ? this->egl_context : EGL_NO_CONTEXT);
+        return;
+    }
+#endif
+    glfwMakeContextCurrent(current ? this->window : nullptr);
+}
+
+
+/* Main thread side of the threaded model: events, input, and frame states. */
+void QGlScene::runThreaded() {
+    this->captureFrameState(this->frames.write());
+    this->frames.publish();
+
+    this->makeContextCurrent(false);
+    this->renderRunning = true;
+    thread renderer(&QGlScene::renderLoop, this);
+
+    auto nextInput = chrono::steady_clock::now();
+    while (!this->shouldClose() && this->renderRunning) {
+        nextInput = max(nextInput + INPUT_PERIOD, chrono::steady_clock::now());
+        if (!this->headless) {
+            auto scope = this->profiler.scope("poll");
+            glfwWaitEventsTimeout(chrono::duration<double>(nextInput - chrono::steady_clock::now()).count());
+        } else
+            this_thread::sleep_until(nextInput);
+
+        this->currentFrame = this->getTime();
+        const float frameTime = this->currentFrame - this->lastFrame;
+        this->lastFrame = this->currentFrame;
+
+        this->dispatchEvents();
+        {
+            auto scope = this->profiler.scope("preProcessInput");
+            this->preProcessInput(*this);
+        }
+        {
+            auto scope = this->profiler.scope("processInput");
+            this->simulate(frameTime);
+        }
+        this->inputSteps++;
+        this->captureFrameState(this->frames.write());
+        this->frames.publish();
+    }
+
+    this->renderRunning = false;
+    renderer.join();
+    this->makeContextCurrent(true);
+}
+
+
+/* Render thread side of the threaded model. */
+void QGlScene::renderLoop() {
+    this->renderThreadId = this_thread::get_id();
+    this->makeContextCurrent(true);
+
+    int width = -1, height = -1;
+    while (this->renderRunning && !this->shouldClose()) {
+        if (this->frames.update())
+            this->renderState = this->frames.read();
+
+        if (this->renderState.width != width || this->renderState.height != height) {
+            width  = this->renderState.width;
+            height = this->renderState.height;
+            this->state.setViewport(0, 0, width, height);
+        }
+
+        this->profiler.beginFrame();
+        this->updateHotReload();
+        this->updateVariants();
+        this->uploadUniformBuffers();
+        this->textures.update();
+        {
+            auto scope = this->profiler.scope("refresh");
+            this->refresh(*this);
+        }
+        if (this->capture.isCapturing()) {
+            auto scope = this->profiler.scope("capture");
+            this->capture.readback(this->fbo, width, height);
+        }
+        if (!this->headless) {
+            auto scope = this->profiler.scope("swap");
+            glfwSwapBuffers(this->window);
+        }
+        this->profiler.endFrame();
+        this->frameCount++;
+
+        this->limitFrameRate();
+    }
+
+    this->makeContextCurrent(false);
+    this->renderRunning = false;
+}
+
+
+void QGlScene::runFrame() {
+    this->currentFrame = this->getTime();
+    const float frameTime = this->currentFrame - this->lastFrame;
+    this->lastFrame = this->currentFrame;
+
+    this->dispatchEvents();
+    if (this->shouldClose())    // A handler may have closed or finalized the scene
+        return;
+    this->profiler.beginFrame();
+    {
+        auto scope = this->profiler.scope("preProcessInput");
         this->preProcessInput(*this);
-        this->processInput(*this);
+    }
+    {
+        auto scope = this->profiler.scope("processInput");
+        this->simulate(frameTime);
+    }
+    this->inputSteps++;
+    this->captureFrameState(this->renderState);
+    this->updateHotReload();
+    this->updateVariants();
+    this->uploadUniformBuffers();
+    this->textures.update();
+    {
+        auto scope = this->profiler.scope("refresh");
         this->refresh(*this);
-        glfwSwapBuffers(this->window);
-        glfwPollEvents();
     }
+    if (this->capture.isCapturing()) {
+        auto scope = this->profiler.scope("capture");
+        this->capture.readback(this->fbo, this->renderState.width, this->renderState.height);
+    }
+    if (!this->headless) {
+        {
+            auto scope = this->profiler.scope("swap");
+            glfwSwapBuffers(this->window);
+        }
+        {
+            auto scope = this->profiler.scope("poll");
+            glfwPollEvents();
+        }
+    }
+    this->profiler.endFrame();
+    this->frameCount++;
+
+    this->limitFrameRate();
+}
+
+
+void QGlScene::simulate(float frameTime) {
+    if (this->fixedStep <= 0.0f) {
+        this->deltaTime = frameTime;
+        this->processInput(*this);
+        this->input.consume();
+        return;
+    }
+
+    this->deltaTime    = this->fixedStep;
+    this->accumulator += frameTime;
+
+    unsigned steps = 0;
+    while (this->accumulator >= this->fixedStep && steps < this->maxSteps) {
+        this->processInput(*this);
+        this->input.consume();          // Frames without a step keep the presses for the next one
+        this->accumulator -= this->fixedStep;
+        steps++;
+    }
+    if (this->accumulator >= this->fixedStep)       // Too far behind: drop the backlog
+        this->accumulator = fmod(this->accumulator, this->fixedStep);
+
+    this->alpha = this->accumulator / this->fixedStep;
 }
 
 
+/* Sleeps for most of the remaining time, then spins for the last stretch,
+ * since sleeps overshoot by up to a scheduler tick. */
+void QGlScene::limitFrameRate() {
+    using clock = chrono::steady_clock;
+    const auto spinMargin = chrono::milliseconds(2);
+
+    if (this->framePeriod == clock::duration::zero())
+        return;
+
+    this->nextFrame += this->framePeriod;
+    auto now = clock::now();
+    if (this->nextFrame < now) {    // Missed the deadline: do not try to catch up
+        this->nextFrame = now;
+        return;
+    }
+
+    if (this->nextFrame - now > spinMargin)
+        this_thread::sleep_for(this->nextFrame - now - spinMargin);
+    while (clock::now() < this->nextFrame)
+        this_thread::yield();
+}
+
+
+/* Destroys the window (or headless context) of this scene only. GLFW is
+ * terminated along with the last scene. Safe to call more than once. */
 void QGlScene::finalize() {
-    glfwTerminate();
+    if (!this->headless) {
+        if (this->window != nullptr) {
+            this->makeContextCurrent(true);
+            this->profiler.release();
+            this->textures.release();
+            this->releaseUniformBuffers();
+            this->capture.stop();
+            glfwDestroyWindow(this->window);
+            this->window = nullptr;
+            QGlState::makeCurrent(nullptr);
+        }
+        if (callback::scene == this)    // Not getInstance(): it calls GLFW, which may be terminated next
+            callback::bindInstance(nullptr);
+        this->releaseGlfw();
+        return;
+    }
+
+#ifdef QGL_EGL
+    if (this->egl_display != nullptr) {
+        this->makeContextCurrent(true);
+        this->profiler.release();
+        this->textures.release();
+        this->releaseUniformBuffers();
+        this->capture.stop();
+        if (this->fbo != 0) {
+            glDeleteFramebuffers(1, &this->fbo);
+            glDeleteRenderbuffers(1, &this->fbo_color);
+            glDeleteRenderbuffers(1, &this->fbo_depth);
+            this->fbo = this->fbo_color = this->fbo_depth = 0;
+        }
+        this->makeContextCurrent(false);
+        if (this->egl_context != nullptr)
+            eglDestroyContext(this->egl_display, this->egl_context);
+
+        lock_guard<mutex> guard(libraryLock);
+        if (--eglUsers == 0)
+            eglTerminate(this->egl_display);
+        this->egl_display = this->egl_context = nullptr;
+    }
+#endif
+}
+
+
+void QGlScene::releaseGlfw() {
+    lock_guard<mutex> guard(libraryLock);
+    if (!this->glfwAcquired)
+        return;
+    this->glfwAcquired = false;
+    if (--glfwUsers == 0)
+        glfwTerminate();
+}
+
+
+/* Must be called before initialize(): the context of this scene will share
+ * its objects (programs, buffers, textures...) with the one of the given scene,
+ * which must be initialized already. Programs are shared as well, so that
+ * withProgram() returns the same, already built, programs in both scenes. */
+QGlScene& QGlScene::withSharedContext(QGlScene& other) {
+    this->sharedWith = &other;
+    this->programs   = other.programs;
+    this->variants   = other.variants;
+    this->stages     = other.stages;
+    this->uniformBuffers = other.uniformBuffers;
+    return *this;
+}
+
+
+/* Runs several scenes (e.g. windows sharing a context) in the same loop, until
+ * all of them are closed. Render threads are not used in this mode. Consider
+ * disabling vsync on all but one window, since each swap waits for it. */
+void QGlScene::runAll(vector<QGlScene*> scenes) {
+    for (QGlScene* scn : scenes) {
+        scn->lastFrame = scn->getTime();
+        scn->nextFrame = chrono::steady_clock::now();
+    }
+
+    bool running = true;
+    while (running) {
+        running = false;
+        for (QGlScene* scn : scenes) {
+            if (scn->shouldClose())
+                continue;
+            running = true;
+            scn->makeContextCurrent(true);
+            scn->runFrame();
+        }
+    }
 }
 
 
@@ -228,22 +1103,35 @@ void QGlScene::setScrollCallback(GLFWscrollfun callback, bool attachNow) {
 
 
 
+void QGlScene::setKeyCallback(GLFWkeyfun callback, bool attachNow) {
+    this->key_callback = callback;
+    if (attachNow)
+        this->attachKeyCallback();
+}
+
+
+
 void QGlScene::attachFrameBufferSizeCallback() {
-    if (this->framebuffer_size_callback != nullptr)
+    if (this->window != nullptr && this->framebuffer_size_callback != nullptr)
         glfwSetFramebufferSizeCallback(this->window, this->framebuffer_size_callback);
 }
 
 void QGlScene::attachMouseButtonCallback() {
-    if (this->mousebtn_callback != nullptr)
+    if (this->window != nullptr && this->mousebtn_callback != nullptr)
         glfwSetMouseButtonCallback(this->window, this->mousebtn_callback);
 }
 
 void QGlScene::attachCursorPositionCallback() {
-    if (this->mouse_callback != nullptr)
+    if (this->window != nullptr && this->mouse_callback != nullptr)
         glfwSetCursorPosCallback(this->window, this->mouse_callback);
 }
 
 void QGlScene::attachScrollCallback() {
-    if (this->scroll_callback != nullptr)
+    if (this->window != nullptr && this->scroll_callback != nullptr)
         glfwSetScrollCallback(this->window, this->scroll_callback);
-}
\ No newline at end of file
+}
+
+void QGlScene::attachKeyCallback() {
+    if (this->window != nullptr && this->key_callback != nullptr)
+        glfwSetKeyCallback(this->window, this->key_callback);
+}
@@ -0,0 +1,173 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    ringbuffer.cpp
+//
+// DESCRIPTION:
+// -----------
+// Streaming buffer for data written by the CPU every frame (dynamic vertices,
+// per-draw uniforms...): a single persistently mapped allocation, split in
+// per-frame regions that are only reused once the GPU is done with them.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/ringbuffer.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+
+static GLsizeiptr QGlAlignUp(GLsizeiptr value, GLsizeiptr alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+
+bool QGlRingBuffer::isSupported() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 4))
+        return true;
+
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* ext = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if (ext != nullptr && strcmp(ext, "GL_ARB_buffer_storage") == 0)
+            return true;
+    }
+    return false;
+}
+
+
+/* Allocates and maps regions of the given size each. The target only sets the
+ * default alignment of allocations (e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT)
+ * and the binding used by bind(): the buffer may be used for anything. */
+bool QGlRingBuffer::create(GLsizeiptr capacity, GLenum target, uint32_t regions) {
+    this->release();
+    if (capacity <= 0 || regions == 0 || !QGlRingBuffer::isSupported())
+        return false;
+
+    GLint alignment = 16;
+    if (target == GL_UNIFORM_BUFFER)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    else if (target == GL_SHADER_STORAGE_BUFFER)
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    this->target    = target;
+    this->alignment = max<GLsizeiptr>(alignment, 16);
+    this->capacity  = capacity;
+    this->stride    = QGlAlignUp(capacity, max<GLsizeiptr>(this->alignment, 256));
+    this->fences.assign(regions, nullptr);
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &this->buffer);
+    QGlState::current().bindBuffer(target, this->buffer);
+    glBufferStorage(target, this->stride * regions, nullptr, flags);
+    this->mapped = (uint8_t*) glMapBufferRange(target, 0, this->stride * regions, flags);
+    if (this->mapped == nullptr) {
+        this->release();
+        return false;
+    }
+    return true;
+}
+
+
+void QGlRingBuffer::release() {
+    for (GLsync& fence : this->fences) {
+        if (fence != nullptr)
+            glDeleteSync(fence);
+        fence = nullptr;
+    }
+    if (this->buffer != 0) {        // Deleting the buffer unmaps it
+        QGlState::current().forgetBuffer(this->buffer);
+        glDeleteBuffers(1, &this->buffer);
+    }
+    this->buffer  = 0;
+    this->mapped  = nullptr;
+    this->head    = 0;
+    this->current = 0;
+    this->inFrame = false;
+}
+
+
+/* Only waits if the GPU has not finished the frame that last used the region,
+ * i.e. if it is as many frames late as there are regions. */
+void QGlRingBuffer::waitFence(uint32_t region) {
+    GLsync& fence = this->fences[region];
+    if (fence == nullptr)
+        return;
+
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        this->stats.stalls++;
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);  // 1 ms
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+
+void QGlRingBuffer::beginFrame() {
+    if (this->buffer == 0)
+        return;
+    if (this->inFrame)
+        this->endFrame();
+
+    if (this->stats.frames > 0)
+        this->current = (this->current + 1) % this->fences.size();
+    this->waitFence(this->current);
+    this->head    = 0;
+    this->inFrame = true;
+    this->stats.frames++;
+}
+
+
+/* Space in the current region, or an invalid allocation if it is full: the
+ * region is never grown, so that no allocation ever happens mid-frame. */
+QGlRingAllocation QGlRingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment) {
+    if (!this->inFrame)
+        this->beginFrame();
+
+    GLsizeiptr start = QGlAlignUp(this->head, alignment > 0 ? alignment : this->alignment);
+    if (this->buffer == 0 || size <= 0 || start + size > this->capacity) {
+        this->stats.overflows += (this->buffer != 0 && size > 0);
+        return QGlRingAllocation();
+    }
+    this->head = start + size;
+
+    GLintptr offset = this->current * this->stride + start;
+    return QGlRingAllocation{ this->mapped + offset, offset, size };
+}
+
+
+/* Marks the end of the commands reading the current region. */
+void QGlRingBuffer::endFrame() {
+    if (!this->inFrame)
+        return;
+    this->fences[this->current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    this->stats.peak = max(this->stats.peak, this->head);
+    this->inFrame = false;
+}
+
+
+void QGlRingBuffer::bind() {
+    QGlState::current().bindBuffer(this->target, this->buffer);
+}
+
+
+/* Binds an allocation to an indexed binding point (uniform or storage buffers). */
+void QGlRingBuffer::bindRange(GLuint index, const QGlRingAllocation& allocation) {
+    QGlState::current().bindBufferRange(this->target, index, this->buffer, allocation.offset, allocation.size);
+}
@@ -17,6 +17,16 @@
 //------------------------------------------------------------------------------
 
 #include "qgl/shader.hpp"
+#include <cstdio>
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+    #include <process.h>
+    #define getpid _getpid
+#else
+    #include <unistd.h>
+#endif
 
 
 const unordered_map<uint16_t, int> QGlShaderType_to_GL = {
@@ -27,6 +37,11 @@ const unordered_map<uint16_t, int> QGlShaderType_to_GL = {
 };
 
 
+fs::path            QGlShader::binaryCache;
+QGlShaderCacheStats QGlShader::cacheStats;
+atomic<uint32_t>    QGlShader::generations = 0;
+
+
 void QGlShaderReport::setReport(const int err, const string msg) {
     error   = err;
     message = msg;
@@ -102,34 +117,51 @@ QGlShader& QGlShader::withShaders(const string computePath) {
 }
 
 
+/* Each define is either a name ("SHADOWS") or a name and a value ("LIGHTS 4"). */
+QGlShader& QGlShader::withDefines(const vector<string>& defines) {
+    this->defines = defines;
+    return *this;
+}
+
+
+/* Sources are expanded by the preprocessor from the process-wide source cache,
+ * so a header shared by many programs is only read from disk once. */
 bool QGlShader::readShader(QGlShaderDef& shader) {
-    try {
-        ifstream file;
-        file.exceptions(ifstream::failbit | ifstream::badbit);
-        file.open(shader.path);
-        stringstream sstream;
-        sstream << file.rdbuf();
-        file.close();
-        shader.code = sstream.str();
-    } catch (ifstream::failure& e) {
-        this->report.setReport(TYPE_READING | shader.type, string(e.what()));
+    QGlPreprocessor preprocessor(this->rootPath);
+    preprocessor.withDefines(this->defines);
+    if (!preprocessor.process(shader.path, shader.code)) {
+        this->report.setReport(TYPE_READING | shader.type, preprocessor.getError());
         return false;
     }
+    shader.includes = preprocessor.getIncludes();
+    shader.hash     = qglHash(shader.code);
     return true;
 }
 
 
-bool QGlShader::compile(QGlShaderDef& shader) {
+/* Only issues the compilation: its status is checked later by finish(). */
+void QGlShader::compile(QGlShaderDef& shader) {
+    if (this->stages != nullptr) {
+        shader.id = this->stages->acquire(shader);
+        if (shader.id != 0)
+            return;
+    }
+
     const char* code = shader.code.c_str();
     shader.id = glCreateShader(QGlShaderType_to_GL.at(shader.type));
     glShaderSource(shader.id, 1, &code, NULL);
     glCompileShader(shader.id);
-    return this->checkErrors(shader);
+
+    if (this->stages != nullptr)
+        this->stages->insert(shader);
 }
 
 
-bool QGlShader::link() {
+/* Only issues the linkage: its status is checked later by finish(). */
+void QGlShader::link() {
     this->id = glCreateProgram();
+    if (!QGlShader::binaryCache.empty())
+        glProgramParameteri(this->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
     switch (this->type) {
         case QGlShaderProgramType::Compute:
@@ -148,69 +180,261 @@ bool QGlShader::link() {
     }
 
     glLinkProgram(this->id);
-    if (!this->checkErrors(this->id, SHADER_PROGRAM))
-        return false;
+}
+
+
+void QGlShader::deleteShaders() {
+    for (QGlShaderDef* stage : { &this->shader.vertex, &this->shader.fragment, &this->shader.geometry, &this->shader.compute }) {
+        if (stage->id == 0)
+            continue;
+        if (this->stages != nullptr)
+            this->stages->release(stage->id);
+        else
+            glDeleteShader(stage->id);
+        stage->id = 0;
+    }
+}
+
+
+bool QGlShader::build() {
+    return this->readShaders() && this->submit() && this->finish();
+}
+
+
+/* Touches no OpenGL state, hence it may run on a worker thread. */
+bool QGlShader::readShaders() {
+    this->report = QGlShaderReport();
 
     switch (this->type) {
         case QGlShaderProgramType::Compute:
-            glDeleteShader(this->shader.compute.id);
+            if (!this->readShader(this->shader.compute))  return false;
             break;
 
         case QGlShaderProgramType::GraphicWithGeometry:
-            glDeleteShader(this->shader.geometry.id);
+            if (!this->readShader(this->shader.geometry)) return false;
 
         case QGlShaderProgramType::GraphicWithoutGeometry:
-            glDeleteShader(this->shader.vertex.id);
-            glDeleteShader(this->shader.fragment.id);
+            if (!this->readShader(this->shader.vertex))   return false;
+            if (!this->readShader(this->shader.fragment)) return false;
+            break;
 
         default:
+            this->report.setReport(TYPE_READING | SHADER_PROGRAM, "no shaders were given");
+            return false;
+    }
+    return true;
+}
+
+
+/* Hands the sources to the driver without waiting for the results, so that
+ * several programs can be compiled concurrently (see GL_KHR_parallel_shader_compile). */
+bool QGlShader::submit() {
+    if (this->loadBinary())
+        return true;
+
+    switch (this->type) {
+        case QGlShaderProgramType::Compute:
+            this->compile(this->shader.compute);
+            break;
+
+        case QGlShaderProgramType::GraphicWithGeometry:
+            this->compile(this->shader.geometry);
+
+        case QGlShaderProgramType::GraphicWithoutGeometry:
+            this->compile(this->shader.vertex);
+            this->compile(this->shader.fragment);
             break;
+
+        default:
+            return false;
     }
 
+    this->link();
+    this->pending = true;
     return true;
 }
 
 
-bool QGlShader::build() {
+/* Does not block: tells if finish() would return immediately. Always true when
+ * GL_KHR_parallel_shader_compile is not enabled in the current context. */
+bool QGlShader::isReady() {
+    if (!this->pending || !QGlState::current().hasParallelCompile())
+        return true;
+    GLint done = GL_TRUE;
+    glGetProgramiv(this->id, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+
+/* Waits for the submitted compilation and linkage and checks their results. */
+bool QGlShader::finish() {
+    if (!this->pending)
+        return this->report.success();
+    this->pending = false;
+
+    bool compiled = true;
     switch (this->type) {
         case QGlShaderProgramType::Compute:
-            if (!this->readShader(this->shader.compute))  return false;
-            if (!this->compile(this->shader.compute))     return false;
+            compiled = this->checkErrors(this->shader.compute);
             break;
 
         case QGlShaderProgramType::GraphicWithGeometry:
-            if (!this->readShader(this->shader.geometry)) return false;
-            if (!this->compile(this->shader.geometry))    return false;
+            compiled = this->checkErrors(this->shader.geometry);
 
         case QGlShaderProgramType::GraphicWithoutGeometry:
-            if (!this->readShader(this->shader.vertex))   return false;
-            if (!this->compile(this->shader.vertex))      return false;
-            if (!this->readShader(this->shader.fragment)) return false;
-            if (!this->compile(this->shader.fragment))    return false;
+            compiled = compiled && this->checkErrors(this->shader.vertex) && this->checkErrors(this->shader.fragment);
             break;
 
         default:
-            return false;
+            break;
+    }
+
+    if (!compiled || !this->checkErrors(this->id, SHADER_PROGRAM)) {
+        this->deleteShaders();
+        return false;
+    }
+
+    this->reflectUniforms();
+    this->deleteShaders();
+    this->storeBinary();
+    this->releaseSources();
+    return true;
+}
+
+
+/* The sources are not needed anymore once the program is linked. */
+void QGlShader::releaseSources() {
+    for (QGlShaderDef* stage : { &this->shader.vertex, &this->shader.fragment, &this->shader.geometry, &this->shader.compute })
+        string().swap(stage->code);
+}
+
+
+/* The cache stays disabled if the directory cannot be created. */
+void QGlShader::setBinaryCache(const fs::path directory) {
+    std::error_code ec;
+    if (!directory.empty() && !fs::create_directories(directory, ec) && ec)
+        QGlShader::binaryCache.clear();
+    else
+        QGlShader::binaryCache = directory;
+}
+
+
+/* The cache key combines the sources of every stage with the driver identity,
+ * since a binary is only valid for the exact driver that produced it. */
+fs::path QGlShader::binaryCachePath() {
+    uint64_t key = QGL_HASH_SEED;
+    for (const GLenum info : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+        const char* str = (const char*) glGetString(info);
+        key = qglHash(str == nullptr ? "" : str, key);
+    }
+    for (const QGlShaderDef* stage : { &this->shader.vertex, &this->shader.fragment, &this->shader.geometry, &this->shader.compute }) {
+        if (stage->type == 0)   // Stage not used by this program
+            continue;
+        key = qglHashBytes(&stage->type, sizeof(stage->type), key);
+        key = qglHashBytes(&stage->hash, sizeof(stage->hash), key);
+    }
+
+    char name[24];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) key);
+    return QGlShader::binaryCache / name;
+}
+
+
+/* Any failure here is silent: the caller falls back to a full compilation. */
+bool QGlShader::loadBinary() {
+    if (QGlShader::binaryCache.empty())
+        return false;
+
+    fs::path path = this->binaryCachePath();
+    ifstream file(path, ios::binary);
+    GLenum format;
+    if (!file || !file.read((char*) &format, sizeof(format))) {
+        QGlShader::cacheStats.misses++;
+        return false;
+    }
+    string binary((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    file.close();
+
+    this->id = glCreateProgram();
+    glProgramBinary(this->id, format, binary.data(), binary.size());
+
+    GLint success;
+    glGetProgramiv(this->id, GL_LINK_STATUS, &success);
+    if (!success) {     // Driver updated or binary corrupted
+        glDeleteProgram(this->id);
+        this->id = 0;
+        std::error_code ec;
+        fs::remove(path, ec);
+        QGlShader::cacheStats.misses++;
+        return false;
     }
 
-    return this->link();
+    this->reflectUniforms();
+    this->releaseSources();
+    QGlShader::cacheStats.hits++;
+    return true;
+}
+
+
+void QGlShader::storeBinary() {
+    if (QGlShader::binaryCache.empty())
+        return;
+
+    GLint formats = 0, length = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    glGetProgramiv(this->id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (formats == 0 || length == 0)
+        return;
+
+    GLenum format;
+    string binary(length, '\0');
+    glGetProgramBinary(this->id, length, NULL, &format, binary.data());
+
+    // Write to a temporary file of this thread first, so that concurrent processes never see a partial binary
+    fs::path path = this->binaryCachePath();
+    fs::path temp = path;
+    temp += "." + to_string(getpid()) + "." + to_string(hash<thread::id>{}(this_thread::get_id())) + ".tmp";
+    ofstream file(temp, ios::binary);
+    file.write((const char*) &format, sizeof(format));
+    file.write(binary.data(), binary.size());
+    file.close();
+
+    std::error_code ec;
+    if (file)
+        fs::rename(temp, path, ec);
+    else
+        fs::remove(temp, ec);
 }
 
 
+/* The log refers to included files by number only: their names are appended to it. */
 bool QGlShader::checkErrors(QGlShaderDef& shader) {
-    return this->checkErrors(shader.id, shader.type);
+    string sources;
+    if (!shader.includes.empty()) {
+        sources = " [source 0: " + shader.path;
+        for (size_t i = 0; i < shader.includes.size(); i++)
+            sources += ", source " + to_string(i + 1) + ": " + shader.includes[i].string();
+        sources += "]";
+    }
+    return this->checkErrors(shader.id, shader.type, sources);
 }
 
-bool QGlShader::checkErrors(uint32_t id, uint16_t type) {
+bool QGlShader::checkErrors(uint32_t id, uint16_t type, const string& sources) {
     GLint success;
     GLchar log[1024];
     const int GL_TYPE_STATUS = (type & SHADER_PROGRAM) ? GL_LINK_STATUS : GL_COMPILE_STATUS;
     const uint16_t QGL_TYPE  = (type & SHADER_PROGRAM) ? TYPE_LINKING   : TYPE_COMPILATION;
 
-    glGetShaderiv(id, GL_TYPE_STATUS, &success);
+    if (type & SHADER_PROGRAM)
+        glGetProgramiv(id, GL_TYPE_STATUS, &success);
+    else
+        glGetShaderiv(id, GL_TYPE_STATUS, &success);
     if (!success) {
-        glGetShaderInfoLog(id, 1024, NULL, log);
-        report.setReport(QGL_TYPE | type, string(log));
+        if (type & SHADER_PROGRAM)
+            glGetProgramInfoLog(id, 1024, NULL, log);
+        else
+            glGetShaderInfoLog(id, 1024, NULL, log);
+        report.setReport(QGL_TYPE | type, string(log) + sources);
         return false;
     }
     return true;
@@ -218,7 +442,46 @@ bool QGlShader::checkErrors(uint32_t id, uint16_t type) {
 
 
 void QGlShader::use() {
-    glUseProgram(this->id);
+    QGlState::current().useProgram(this->id);
+}
+
+
+/* Deletes the program. The shader remains configured and can be built again. */
+void QGlShader::release() {
+    if (this->id != 0) {
+        QGlState::current().forgetProgram(this->id);
+        glDeleteProgram(this->id);
+    }
+    this->id = 0;
+    this->uniforms.clear();
+}
+
+
+/* Copy of the configuration only (paths, type and defines), to build another program from it. */
+QGlShader QGlShader::clone() const {
+    QGlShader copy(this->rootPath.c_str());
+    copy.shader  = this->shader;
+    copy.type    = this->type;
+    copy.defines = this->defines;
+    copy.stages  = this->stages;
+    for (QGlShaderDef* stage : { &copy.shader.vertex, &copy.shader.fragment, &copy.shader.geometry, &copy.shader.compute })
+        stage->id = 0;
+    return copy;
+}
+
+
+/* Files of every stage, including the ones they included when last read. */
+vector<fs::path> QGlShader::getPaths() {
+    vector<fs::path> paths;
+    for (const QGlShaderDef* stage : { &this->shader.vertex, &this->shader.fragment, &this->shader.geometry, &this->shader.compute }) {
+        if (stage->type == 0)
+            continue;
+        paths.push_back(stage->path);
+        for (const fs::path& include : stage->includes)
+            if (find(paths.begin(), paths.end(), include) == paths.end())
+                paths.push_back(include);
+    }
+    return paths;
 }
 
 
@@ -233,61 +496,230 @@ QGlShaderDef QGlShader::getShader(uint16_t type) {
 }
 
 
+uint64_t QGlStageCache::key(const QGlShaderDef& shader) {
+    return qglHashBytes(&shader.type, sizeof(shader.type), shader.hash);
+}
+
+
+/* Shader object compiled from the same sources, or 0 if there is none alive. */
+GLuint QGlStageCache::acquire(const QGlShaderDef& shader) {
+    auto it = this->stages.find(QGlStageCache::key(shader));
+    if (it == this->stages.end())
+        return 0;
+    it->second.users++;
+    this->stats.reused++;
+    return it->second.id;
+}
+
+
+/* Registers a newly compiled shader object, with its first user. */
+void QGlStageCache::insert(const QGlShaderDef& shader) {
+    uint64_t key = QGlStageCache::key(shader);
+    this->stages[key]     = QGlStage{ shader.id, 1 };
+    this->keys[shader.id] = key;
+    this->stats.compiled++;
+}
+
+
+/* Called by each user once linked: the last one deletes the shader object. */
+void QGlStageCache::release(GLuint id) {
+    auto key = this->keys.find(id);
+    if (key == this->keys.end()) {
+        glDeleteShader(id);
+        return;
+    }
+    auto it = this->stages.find(key->second);
+    if (--it->second.users > 0)
+        return;
+    glDeleteShader(id);
+    this->stages.erase(it);
+    this->keys.erase(key);
+}
+
+
+/* Lists every active uniform of the freshly linked program, so that the set*
+ * methods can resolve names without asking the driver. */
+void QGlShader::reflectUniforms() {
+    this->uniforms.clear();
+    this->generation = ++QGlShader::generations;
+
+    GLint count, maxLength;
+    glGetProgramiv(this->id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(this->id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    string name(maxLength, '\0');
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length;
+        GLint   size;
+        GLenum  type;
+        glGetActiveUniform(this->id, i, maxLength, &length, &size, &type, name.data());
+
+        string uniform = name.substr(0, length);
+        GLint location = glGetUniformLocation(this->id, uniform.c_str());
+        if (location < 0)       // Uniform block members have no location
+            continue;
+
+        this->uniforms[uniform] = location;
+        // Arrays are reported as "name[0]", but are usually addressed as "name"
+        if (uniform.ends_with("[0]"))
+            this->uniforms[uniform.substr(0, uniform.size() - 3)] = location;
+    }
+
+    this->bindUniformBlocks();
+}
+
+
+/* Binds the blocks managed by a QGlUniformBuffer to their binding points.
+ * Done when the program is linked: only needed for programs linked before the
+ * buffer was created. */
+void QGlShader::bindUniformBlocks() {
+    if (this->id != 0)
+        QGlUniformBuffer::bindBlocks(this->id);
+}
+
+
+/* Names not found by reflection (e.g. "lights[3]") are asked to the driver
+ * once and memoized, including unknown ones. */
+GLint QGlShader::uniformLocation(const string& name) const {
+    auto it = this->uniforms.find(name);
+    if (it != this->uniforms.end())
+        return it->second;
+    GLint location = glGetUniformLocation(this->id, name.c_str());
+    this->uniforms.emplace(name, location);
+    return location;
+}
+
+
+/* Resolved again if the handle comes from an earlier link of the program. */
+GLint QGlShader::uniformLocation(const QGlUniform& uniform) const {
+    if (uniform.generation != this->generation) {
+        uniform.location   = this->uniformLocation(uniform.name);
+        uniform.generation = this->generation;
+    }
+    return uniform.location;
+}
+
+
+QGlUniform QGlShader::getUniform(const string& name) const {
+    return QGlUniform{ name, this->uniformLocation(name), this->generation };
+}
+
+
 void QGlShader::setBool(const string& name, bool value) const {
-    glUniform1i(glGetUniformLocation(this->id, name.c_str()), (int) value);
+    glUniform1i(this->uniformLocation(name), (int) value);
 }
 
 
 void QGlShader::setInt(const string& name, int value) const {
-    glUniform1i(glGetUniformLocation(this->id, name.c_str()), value);
+    glUniform1i(this->uniformLocation(name), value);
 }
 
 
 void QGlShader::setFloat(const string& name, float value) const {
-    glUniform1f(glGetUniformLocation(this->id, name.c_str()), value);
+    glUniform1f(this->uniformLocation(name), value);
 }
 
 
 void QGlShader::setVec2(const string& name, const glm::vec2& value) const {
-    glUniform2fv(glGetUniformLocation(this->id, name.c_str()), 1, &value[0]);
+    glUniform2fv(this->uniformLocation(name), 1, &value[0]);
 }
 
 
 void QGlShader::setVec2(const string& name, float x, float y) const {
-    glUniform2f(glGetUniformLocation(this->id, name.c_str()), x, y);
+    glUniform2f(this->uniformLocation(name), x, y);
 }
 
 
 void QGlShader::setVec3(const string& name, const glm::vec3& value) const {
-    glUniform3fv(glGetUniformLocation(this->id, name.c_str()), 1, &value[0]);
+    glUniform3fv(this->uniformLocation(name), 1, &value[0]);
 }
 
 
 void QGlShader::setVec3(const string& name, float x, float y, float z) const {
-    glUniform3f(glGetUniformLocation(this->id, name.c_str()), x, y, z);
+    glUniform3f(this->uniformLocation(name), x, y, z);
 }
 
 
 void QGlShader::setVec4(const string& name, const glm::vec4& value) const {
-    glUniform4fv(glGetUniformLocation(this->id, name.c_str()), 1, &value[0]);
+    glUniform4fv(this->uniformLocation(name), 1, &value[0]);
 }
 
 
 void QGlShader::setVec4(const string& name, float x, float y, float z, float w) const {
-    glUniform4f(glGetUniformLocation(this->id, name.c_str()), x, y, z, w);
+    glUniform4f(this->uniformLocation(name), x, y, z, w);
 }
 
 
 void QGlShader::setMat2(const string& name, const glm::mat2& mat) const {
-    glUniformMatrix2fv(glGetUniformLocation(this->id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix2fv(this->uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 }
 
 
 void QGlShader::setMat3(const string& name, const glm::mat3& mat) const {
-    glUniformMatrix3fv(glGetUniformLocation(this->id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix3fv(this->uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 }
 
 
 void QGlShader::setMat4(const string& name, const glm::mat4& mat) const {
-    glUniformMatrix4fv(glGetUniformLocation(this->id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix4fv(this->uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
+}
+
+
+void QGlShader::setBool(const QGlUniform& uniform, bool value) const {
+    glUniform1i(this->uniformLocation(uniform), (int) value);
+}
+
+
+void QGlShader::setInt(const QGlUniform& uniform, int value) const {
+    glUniform1i(this->uniformLocation(uniform), value);
+}
+
+
+void QGlShader::setFloat(const QGlUniform& uniform, float value) const {
+    glUniform1f(this->uniformLocation(uniform), value);
+}
+
+
+void QGlShader::setVec2(const QGlUniform& uniform, const glm::vec2& value) const {
+    glUniform2fv(this->uniformLocation(uniform), 1, &value[0]);
+}
+
+
+void QGlShader::setVec2(const QGlUniform& uniform, float x, float y) const {
+    glUniform2f(this->uniformLocation(uniform), x, y);
+}
+
+
+void QGlShader::setVec3(const QGlUniform& uniform, const glm::vec3& value) const {
+    glUniform3fv(this->uniformLocation(uniform), 1, &value[0]);
+}
+
+
+void QGlShader::setVec3(const QGlUniform& uniform, float x, float y, float z) const {
+    glUniform3f(this->uniformLocation(uniform), x, y, z);
+}
+
+
+void QGlShader::setVec4(const QGlUniform& uniform, const glm::vec4& value) const {
+    glUniform4fv(this->uniformLocation(uniform), 1, &value[0]);
+}
+
+
+void QGlShader::setVec4(const QGlUniform& uniform, float x, float y, float z, float w) const {
+    glUniform4f(this->uniformLocation(uniform), x, y, z, w);
+}
+
+
+void QGlShader::setMat2(const QGlUniform& uniform, const glm::mat2& mat) const {
+    glUniformMatrix2fv(this->uniformLocation(uniform), 1, GL_FALSE, &mat[0][0]);
+}
+
+
+void QGlShader::setMat3(const QGlUniform& uniform, const glm::mat3& mat) const {
+    glUniformMatrix3fv(this->uniformLocation(uniform), 1, GL_FALSE, &mat[0][0]);
+}
+
+
+void QGlShader::setMat4(const QGlUniform& uniform, const glm::mat4& mat) const {
+    glUniformMatrix4fv(this->uniformLocation(uniform), 1, GL_FALSE, &mat[0][0]);
 }
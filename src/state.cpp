@@ -0,0 +1,306 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    state.cpp
+//
+// DESCRIPTION:
+// -----------
+// Shadow copy of the OpenGL state of a context, so that binding what is
+// already bound (or enabling what is already enabled) never reaches the driver.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/state.hpp"
+
+
+static thread_local QGlState* QGlCurrentState = nullptr;
+
+atomic<uint64_t> QGlState::deletions = 0;
+
+
+QGlState& QGlState::current() {
+    static thread_local QGlState fallback;
+    return (QGlCurrentState != nullptr) ? *QGlCurrentState : fallback;
+}
+
+
+/* Called whenever a context becomes current on this thread (nullptr: none). */
+void QGlState::makeCurrent(QGlState* state) {
+    QGlCurrentState = state;
+}
+
+
+/* Counts the request: true if it must reach the driver. */
+bool QGlState::changed(bool differs) {
+    if (differs)
+        this->stats.issued++;
+    else
+        this->stats.skipped++;
+    return differs;
+}
+
+
+/* Forgets the bindings of shareable objects if another state forgot one of
+ * them since: its name may have been given to a new object. */
+void QGlState::sync() {
+    uint64_t count = QGlState::deletions.load(memory_order_acquire);
+    if (this->seen != count) {
+        this->forgetShared();
+        this->seen = count;
+    }
+}
+
+
+/* Counts a deletion of a shareable object, which this state already forgot. */
+void QGlState::deleted() {
+    uint64_t previous = QGlState::deletions.fetch_add(1, memory_order_acq_rel);
+    if (this->seen == previous)
+        this->seen = previous + 1;
+}
+
+
+void QGlState::forgetShared() {
+    this->program       = QGlState::UNKNOWN;
+    this->arrayBuffer   = QGlState::UNKNOWN;
+    this->elementBuffer = QGlState::UNKNOWN;
+    this->uniformBuffer = QGlState::UNKNOWN;
+    this->storageBuffer = QGlState::UNKNOWN;
+    this->indexedBuffers.clear();
+    this->textures.fill(QGlTextureBinding());
+}
+
+
+GLuint* QGlState::bufferBinding(GLenum target) {
+    switch (target) {
+        case GL_ARRAY_BUFFER:          return &this->arrayBuffer;
+        case GL_ELEMENT_ARRAY_BUFFER:  return &this->elementBuffer;
+        case GL_UNIFORM_BUFFER:        return &this->uniformBuffer;
+        case GL_SHADER_STORAGE_BUFFER: return &this->storageBuffer;
+        default:                       return nullptr;
+    }
+}
+
+
+int QGlState::capability(GLenum cap) {
+    switch (cap) {
+        case GL_BLEND:      return 0;
+        case GL_DEPTH_TEST: return 1;
+        case GL_CULL_FACE:  return 2;
+        default:            return -1;
+    }
+}
+
+
+void QGlState::useProgram(GLuint id) {
+    this->sync();
+    if (this->changed(this->program != id)) {
+        glUseProgram(id);
+        this->program = id;
+    }
+}
+
+
+/* The element buffer binding belongs to the vertex array, so it becomes unknown. */
+void QGlState::bindVertexArray(GLuint id) {
+    if (this->changed(this->vertexArray != id)) {
+        glBindVertexArray(id);
+        this->vertexArray   = id;
+        this->elementBuffer = QGlState::UNKNOWN;
+    }
+}
+
+
+/* Targets other than array, element, uniform and storage buffers are not tracked. */
+void QGlState::bindBuffer(GLenum target, GLuint id) {
+    this->sync();
+    GLuint* binding = this->bufferBinding(target);
+    if (this->changed(binding == nullptr || *binding != id)) {
+        glBindBuffer(target, id);
+        if (binding != nullptr)
+            *binding = id;
+    }
+}
+
+
+/* Also binds the generic binding point of the target, as OpenGL does. */
+void QGlState::bindBufferBase(GLenum target, GLuint index, GLuint id) {
+    this->sync();
+    uint64_t key = (uint64_t(target) << 32) | index;
+    auto it = this->indexedBuffers.find(key);
+    if (this->changed(it == this->indexedBuffers.end() || it->second != id)) {
+        glBindBufferBase(target, index, id);
+        this->indexedBuffers[key] = id;
+        if (GLuint* binding = this->bufferBinding(target))
+            *binding = id;
+    }
+}
+
+
+/* Ranges change with every sub-allocation: always issued, and the indexed
+ * binding becomes unknown to bindBufferBase(). */
+void QGlState::bindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size) {
+    this->sync();
+    this->changed(true);
+    glBindBufferRange(target, index, id, offset, size);
+    this->indexedBuffers[(uint64_t(target) << 32) | index] = QGlState::UNKNOWN;
+    if (GLuint* binding = this->bufferBinding(target))
+        *binding = id;
+}
+
+
+void QGlState::bindTexture(GLuint unit, GLenum target, GLuint id) {
+    this->sync();
+    if (unit >= this->textures.size()) {     // Not tracked
+        this->stats.issued += 2;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, id);
+        this->activeUnit = GL_TEXTURE0 + unit;
+        return;
+    }
+
+    QGlTextureBinding& binding = this->textures[unit];
+    if (!this->changed(binding.target != target || binding.id != id))
+        return;
+    if (this->changed(this->activeUnit != GL_TEXTURE0 + unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        this->activeUnit = GL_TEXTURE0 + unit;
+    }
+    glBindTexture(target, id);
+    binding.target = target;
+    binding.id     = id;
+}
+
+
+void QGlState::enable(GLenum cap) {
+    this->setEnabled(cap, true);
+}
+
+
+void QGlState::disable(GLenum cap) {
+    this->setEnabled(cap, false);
+}
+
+
+/* Capabilities other than blend, depth test and face culling are not tracked. */
+void QGlState::setEnabled(GLenum cap, bool enable) {
+    int index = QGlState::capability(cap);
+    if (!this->changed(index < 0 || this->enabled[index] != (int8_t) enable))
+        return;
+    if (enable)
+        glEnable(cap);
+    else
+        glDisable(cap);
+    if (index >= 0)
+        this->enabled[index] = enable;
+}
+
+
+void QGlState::blendFunc(GLenum src, GLenum dst) {
+    if (this->changed(this->blendSrc != src || this->blendDst != dst)) {
+        glBlendFunc(src, dst);
+        this->blendSrc = src;
+        this->blendDst = dst;
+    }
+}
+
+
+void QGlState::setDepthFunc(GLenum func) {
+    if (this->changed(this->depthFunc != func)) {
+        glDepthFunc(func);
+        this->depthFunc = func;
+    }
+}
+
+
+void QGlState::setDepthMask(bool mask) {
+    if (this->changed(this->depthMask != (int8_t) mask)) {
+        glDepthMask(mask ? GL_TRUE : GL_FALSE);
+        this->depthMask = mask;
+    }
+}
+
+
+void QGlState::setCullFace(GLenum face) {
+    if (this->changed(this->cullFace != face)) {
+        glCullFace(face);
+        this->cullFace = face;
+    }
+}
+
+
+void QGlState::setViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    array<GLint, 4> viewport = { x, y, width, height };
+    if (this->changed(this->viewport != viewport)) {
+        glViewport(x, y, width, height);
+        this->viewport = viewport;
+    }
+}
+
+
+/* A deleted program stays in use until another one is, and its name may then
+ * be given to a new program: the binding becomes unknown. */
+void QGlState::forgetProgram(GLuint id) {
+    this->sync();
+    if (this->program == id)
+        this->program = QGlState::UNKNOWN;
+    this->deleted();
+}
+
+
+void QGlState::forgetVertexArray(GLuint id) {
+    if (this->vertexArray == id) {
+        this->vertexArray   = QGlState::UNKNOWN;
+        this->elementBuffer = QGlState::UNKNOWN;
+    }
+}
+
+
+void QGlState::forgetBuffer(GLuint id) {
+    this->sync();
+    for (GLuint* binding : { &this->arrayBuffer, &this->elementBuffer, &this->uniformBuffer, &this->storageBuffer })
+        if (*binding == id)
+            *binding = QGlState::UNKNOWN;
+    for (auto& [key, buffer] : this->indexedBuffers)
+        if (buffer == id)
+            buffer = QGlState::UNKNOWN;
+    this->deleted();
+}
+
+
+void QGlState::forgetTexture(GLuint id) {
+    this->sync();
+    for (QGlTextureBinding& binding : this->textures)
+        if (binding.id == id)
+            binding.id = QGlState::UNKNOWN;
+    this->deleted();
+}
+
+
+/* Forgets everything: the next request of each kind reaches the driver. */
+void QGlState::invalidate() {
+    this->program       = QGlState::UNKNOWN;
+    this->vertexArray   = QGlState::UNKNOWN;
+    this->arrayBuffer   = QGlState::UNKNOWN;
+    this->elementBuffer = QGlState::UNKNOWN;
+    this->uniformBuffer = QGlState::UNKNOWN;
+    this->storageBuffer = QGlState::UNKNOWN;
+    this->indexedBuffers.clear();
+    this->activeUnit = 0;
+    this->textures.fill(QGlTextureBinding());
+    this->enabled.fill(-1);
+    this->blendSrc  = this->blendDst = 0;
+    this->depthFunc = 0;
+    this->depthMask = -1;
+    this->cullFace  = 0;
+    this->viewport.fill(-1);
+    this->seen = QGlState::deletions.load(memory_order_acquire);
+}
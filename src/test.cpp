@@ -27,10 +27,10 @@
 using namespace qgl;
 
 /* Example of how to extend the qgl_callback namespace.
- * getInstance() must be used to access the QGlScene instance currently bound. */
+ * getInstance(window) must be used to access the QGlScene instance of the window. */
 namespace qgl::callback {
     void foo(GLFWwindow *window, int button, int action, int mods) {
-        getInstance()->finalize();
+        getInstance(window)->finalize();
     }
 }
 
@@ -0,0 +1,493 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    text.cpp
+//
+// DESCRIPTION:
+// -----------
+// Text rendering with FreeType (requires QGL_FREETYPE): glyphs rasterized on
+// demand into atlas pages packed with a skyline, and strings drawn as quads
+// streamed through one buffer, with one draw per atlas page.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#ifdef QGL_FREETYPE
+
+#include "qgl/text.hpp"
+
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+
+void QGlSkyline::reset(int width, int height) {
+    this->width  = width;
+    this->height = height;
+    this->nodes.assign(1, QGlSkylineNode{ 0, 0, width });
+}
+
+
+/* The top of a rectangle placed at the left of the i-th segment, resting on
+ * the segments below it: -1 if it does not fit there. */
+int QGlSkyline::fit(size_t i, int width, int height) const {
+    if (this->nodes[i].x + width > this->width)
+        return -1;
+    int y = 0;
+    for (int left = width; left > 0; left -= this->nodes[i].width, i++) {
+        y = max(y, this->nodes[i].y);
+        if (y + height > this->height)
+            return -1;
+    }
+    return y;
+}
+
+
+/* Places a rectangle where its bottom is lowest (on the narrowest segment,
+ * among equals), then raises the skyline under it. */
+bool QGlSkyline::pack(int width, int height, int& x, int& y) {
+    size_t best       = this->nodes.size();
+    int    bestBottom = INT32_MAX, bestWidth = INT32_MAX;
+    for (size_t i = 0; i < this->nodes.size(); i++) {
+        int top = this->fit(i, width, height);
+        if (top >= 0 && (top + height < bestBottom || (top + height == bestBottom && this->nodes[i].width < bestWidth))) {
+            best       = i;
+            bestBottom = top + height;
+            bestWidth  = this->nodes[i].width;
+        }
+    }
+    if (best == this->nodes.size())
+        return false;
+    x = this->nodes[best].x;
+    y = bestBottom - height;
+
+    // The new segment covers the ones under the rectangle, entirely or in part
+    this->nodes.insert(this->nodes.begin() + best, QGlSkylineNode{ x, bestBottom, width });
+    for (size_t i = best + 1; i < this->nodes.size(); ) {
+        int overlap = this->nodes[i - 1].x + this->nodes[i - 1].width - this->nodes[i].x;
+        if (overlap <= 0)
+            break;
+        this->nodes[i].x     += overlap;
+        this->nodes[i].width -= overlap;
+        if (this->nodes[i].width > 0)
+            break;
+        this->nodes.erase(this->nodes.begin() + i);
+    }
+    for (size_t i = 0; i + 1 < this->nodes.size(); ) {
+        if (this->nodes[i].y == this->nodes[i + 1].y) {
+            this->nodes[i].width += this->nodes[i + 1].width;
+            this->nodes.erase(this->nodes.begin() + i + 1);
+        } else
+            i++;
+    }
+    return true;
+}
+
+
+/* Fibonacci hashing: the high bits of the product spread consecutive code
+ * points across the table. */
+size_t QGlGlyphTable::slot(uint32_t key) const {
+    return size_t((uint64_t(key) * 0x9E3779B97F4A7C15ull) >> 32) & (this->keys.size() - 1);
+}
+
+
+const QGlGlyph* QGlGlyphTable::find(uint32_t key) const {
+    if (this->keys.empty())
+        return nullptr;
+    for (size_t i = this->slot(key); this->keys[i] != EMPTY; i = (i + 1) & (this->keys.size() - 1))
+        if (this->keys[i] == key)
+            return &this->glyphs[i];
+    return nullptr;
+}
+
+
+/* Grows to keep the table at most half full, so that probes stay short. */
+void QGlGlyphTable::insert(uint32_t key, const QGlGlyph& glyph) {
+    if ((this->count + 1) * 2 > this->keys.size()) {
+        vector<uint32_t> keys   = move(this->keys);
+        vector<QGlGlyph> glyphs = move(this->glyphs);
+        this->keys.assign(max<size_t>(64, keys.size() * 2), EMPTY);
+        this->glyphs.assign(this->keys.size(), QGlGlyph());
+        this->count = 0;
+        for (size_t i = 0; i < keys.size(); i++)
+            if (keys[i] != EMPTY)
+                this->insert(keys[i], glyphs[i]);
+    }
+
+    size_t i = this->slot(key);
+    while (this->keys[i] != EMPTY && this->keys[i] != key)
+        i = (i + 1) & (this->keys.size() - 1);
+    this->count += (this->keys[i] == EMPTY);
+    this->keys[i]   = key;
+    this->glyphs[i] = glyph;
+}
+
+
+/* The next code point of a UTF-8 string: U+FFFD for invalid sequences. */
+static uint32_t QGlNextCodePoint(string_view text, size_t& i) {
+    uint8_t lead = text[i++];
+    if (lead < 0x80)
+        return lead;
+    int length = (lead >= 0xF0) ? 3 : (lead >= 0xE0) ? 2 : (lead >= 0xC0) ? 1 : 0;
+    if (length == 0 || i + length > text.size())
+        return 0xFFFD;
+    uint32_t code = lead & (0x3F >> length);
+    for (int k = 0; k < length; k++, i++) {
+        if ((uint8_t(text[i]) & 0xC0) != 0x80)
+            return 0xFFFD;
+        code = (code << 6) | (uint8_t(text[i]) & 0x3F);
+    }
+    return code;
+}
+
+
+static const char* QGL_TEXT_VERTEX = R"(#version 330 core
+layout(location = 0) in vec4 rect;          // Pixels: left, top, right, bottom
+layout(location = 1) in vec4 texRect;
+layout(location = 2) in vec4 color;
+
+uniform vec2 viewport;
+
+out vec2 uv;
+out vec4 tint;
+
+void main() {
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    uv   = mix(texRect.xy, texRect.zw, corner);
+    tint = color;
+    gl_Position = vec4(mix(rect.xy, rect.zw, corner) / viewport * vec2(2.0, -2.0) + vec2(-1.0, 1.0), 0.0, 1.0);
+}
+)";
+
+static const char* QGL_TEXT_FRAGMENT = R"(#version 330 core
+in vec2 uv;
+in vec4 tint;
+
+uniform sampler2D atlas;
+
+out vec4 fragColor;
+
+void main() {
+    fragColor = vec4(tint.rgb, tint.a * texture(atlas, uv).r);
+}
+)";
+
+
+bool QGlText::compileProgram() {
+    GLint success = 0;
+    char  log[1024];
+    this->program = glCreateProgram();
+    for (auto [type, source] : { make_pair(GL_VERTEX_SHADER, QGL_TEXT_VERTEX), make_pair(GL_FRAGMENT_SHADER, QGL_TEXT_FRAGMENT) }) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            this->error = string("Text shader: compilation failed: ") + log;
+            glDeleteShader(shader);
+            return false;
+        }
+        glAttachShader(this->program, shader);
+        glDeleteShader(shader);
+    }
+
+    glLinkProgram(this->program);
+    glGetProgramiv(this->program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(this->program, sizeof(log), nullptr, log);
+        this->error = string("Text shader: linking failed: ") + log;
+        return false;
+    }
+    this->viewportLocation = glGetUniformLocation(this->program, "viewport");
+    return true;
+}
+
+
+/* Side of the atlas pages created from then on, in texels. */
+QGlText& QGlText::withPageSize(int size) {
+    this->pageSize = clamp(size, 64, 8192);
+    return *this;
+}
+
+
+/* Capacity: glyphs drawn per flush. False if it fails (see getError()),
+ * e.g. before OpenGL 4.4. */
+bool QGlText::create(uint32_t capacity, uint32_t regions) {
+    this->release();
+    if (!QGlRingBuffer::isSupported()) {
+        this->error = "Text: requires OpenGL 4.4 or GL_ARB_buffer_storage";
+        return false;
+    }
+    if (FT_Init_FreeType(&this->library) != 0) {
+        this->library = nullptr;
+        this->error   = "Text: FreeType could not be initialized";
+        return false;
+    }
+    if (!this->compileProgram() || !this->stream.create(GLsizeiptr(capacity) * sizeof(QGlTextQuad), GL_ARRAY_BUFFER, regions)) {
+        if (this->error.empty())
+            this->error = "Text: the stream could not be created";
+        this->release();
+        return false;
+    }
+    glGenVertexArrays(1, &this->vao);
+    return true;
+}
+
+
+void QGlText::release() {
+    QGlState& state = QGlState::current();
+    for (QGlFontFace& font : this->fonts)
+        FT_Done_Face(font.face);
+    this->fonts.clear();
+    if (this->library != nullptr)
+        FT_Done_FreeType(this->library);
+    this->library = nullptr;
+
+    for (QGlAtlasPage& page : this->pages) {
+        state.forgetTexture(page.texture);
+        glDeleteTextures(1, &page.texture);
+    }
+    this->pages.clear();
+    if (this->vao != 0) {
+        state.forgetVertexArray(this->vao);
+        glDeleteVertexArrays(1, &this->vao);
+    }
+    if (this->program != 0) {
+        state.forgetProgram(this->program);
+        glDeleteProgram(this->program);
+    }
+    this->vao     = 0;
+    this->program = 0;
+    this->stream.release();
+    this->stats = QGlTextStats();
+}
+
+
+/* Loads a font at a size in pixels: its index, or -1 (see getError()). */
+int QGlText::addFont(const fs::path& path, int pixels) {
+    if (this->library == nullptr) {
+        this->error = "Text: fonts are added after create()";
+        return -1;
+    }
+    FT_Face face;
+    if (FT_New_Face(this->library, path.string().c_str(), 0, &face) != 0) {
+        this->error = path.string() + ": not a font, or unreadable";
+        return -1;
+    }
+    FT_Set_Pixel_Sizes(face, 0, pixels);
+
+    QGlFontFace font;
+    font.face       = face;
+    font.ascender   = face->size->metrics.ascender / 64.0f;
+    font.lineHeight = face->size->metrics.height / 64.0f;
+    this->fonts.push_back(move(font));
+    return this->fonts.size() - 1;
+}
+
+
+/* Pages start cleared, so that sampling the gaps between glyphs gives 0. */
+bool QGlText::addPage() {
+    if (this->pages.size() > UINT16_MAX)
+        return false;
+    QGlAtlasPage page;
+    glGenTextures(1, &page.texture);
+    QGlState::current().bindTexture(0, GL_TEXTURE_2D, page.texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, this->pageSize, this->pageSize);
+    uint8_t zero = 0;
+    glClearTexImage(page.texture, 0, GL_RED, GL_UNSIGNED_BYTE, &zero);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    page.packer.reset(this->pageSize, this->pageSize);
+    this->pages.push_back(move(page));
+    this->stats.pages = this->pages.size();
+    return true;
+}
+
+
+/* The cached glyph, or rasterizes it into the first page with room for it
+ * (a new one if none). Glyphs missing from the font are drawn as the font's
+ * "missing glyph"; glyphs larger than a page are not drawn. */
+QGlGlyph QGlText::glyph(QGlFontFace& font, uint32_t code) {
+    if (const QGlGlyph* cached = font.glyphs.find(code))
+        return *cached;
+
+    QGlGlyph glyph;
+    if (FT_Load_Char(font.face, code, FT_LOAD_RENDER) == 0) {
+        FT_GlyphSlot   slot   = font.face->glyph;
+        const FT_Bitmap& bitmap = slot->bitmap;
+        glyph.advance = slot->advance.x / 64.0f;
+        glyph.left    = slot->bitmap_left;
+        glyph.top     = slot->bitmap_top;
+
+        // A texel of gap between glyphs, for filtering
+        int x = 0, y = 0;
+        bool placed = false;
+        if (bitmap.width > 0 && bitmap.rows > 0 && bitmap.pixel_mode == FT_PIXEL_MODE_GRAY) {
+            for (size_t page = 0; page < this->pages.size() && !placed; page++)
+                if ((placed = this->pages[page].packer.pack(bitmap.width + 1, bitmap.rows + 1, x, y)))
+                    glyph.page = page;
+            bool fits = int(bitmap.width) < this->pageSize && int(bitmap.rows) < this->pageSize;
+            if (!placed && fits && this->addPage() && (placed = this->pages.back().packer.pack(bitmap.width + 1, bitmap.rows + 1, x, y)))
+                glyph.page = this->pages.size() - 1;
+        }
+
+        if (placed) {
+            glyph.x      = x;
+            glyph.y      = y;
+            glyph.width  = bitmap.width;
+            glyph.height = bitmap.rows;
+
+            QGlState& state = QGlState::current();
+            state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            state.bindTexture(0, GL_TEXTURE_2D, this->pages[glyph.page].texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, bitmap.pitch);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, bitmap.width, bitmap.rows, GL_RED, GL_UNSIGNED_BYTE, bitmap.buffer);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+    }
+    font.glyphs.insert(code, glyph);
+    this->stats.cached++;
+    return glyph;
+}
+
+
+/* Queues the quads of a string, to be drawn by the next flush(): returns the
+ * position where the next string would follow it. No kerning or shaping. */
+glm::vec2 QGlText::print(int index, glm::vec2 position, string_view text, glm::vec4 color) {
+    if (index < 0 || size_t(index) >= this->fonts.size())
+        return position;
+    QGlFontFace& font = this->fonts[index];
+
+    auto channel = [](float c) { return uint32_t(clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f); };
+    uint32_t rgba  = channel(color.x) | (channel(color.y) << 8) | (channel(color.z) << 16) | (channel(color.w) << 24);
+    float    scale = 65535.0f / this->pageSize;
+
+    float x = position.x, baseline = position.y + font.ascender;
+    for (size_t i = 0; i < text.size(); ) {
+        uint32_t code = QGlNextCodePoint(text, i);
+        if (code == '\n') {
+            x = position.x;
+            baseline += font.lineHeight;
+            continue;
+        }
+        QGlGlyph glyph = this->glyph(font, code);
+        if (glyph.width > 0) {
+            float x0 = roundf(x + glyph.left), y0 = roundf(baseline - glyph.top);      // Whole pixels: crisp glyphs
+            this->pages[glyph.page].quads.push_back(QGlTextQuad {
+                x0, y0, x0 + glyph.width, y0 + glyph.height,
+                uint16_t(glyph.x * scale + 0.5f), uint16_t(glyph.y * scale + 0.5f),
+                uint16_t((glyph.x + glyph.width) * scale + 0.5f), uint16_t((glyph.y + glyph.height) * scale + 0.5f),
+                rgba });
+        }
+        x += glyph.advance;
+    }
+    return glm::vec2(x, baseline - font.ascender);
+}
+
+
+/* Width and height of a string, in pixels. */
+glm::vec2 QGlText::measure(int index, string_view text) {
+    if (index < 0 || size_t(index) >= this->fonts.size())
+        return glm::vec2(0.0f);
+    QGlFontFace& font = this->fonts[index];
+
+    float x = 0.0f, width = 0.0f, height = font.lineHeight;
+    for (size_t i = 0; i < text.size(); ) {
+        uint32_t code = QGlNextCodePoint(text, i);
+        if (code == '\n') {
+            x = 0.0f;
+            height += font.lineHeight;
+            continue;
+        }
+        x += this->glyph(font, code).advance;
+        width = max(width, x);
+    }
+    return glm::vec2(width, height);
+}
+
+
+/* Draws everything printed since the last flush, over a viewport of the
+ * given size: the quads of all pages share one allocation of the stream,
+ * and each page is one instanced draw of its range. */
+void QGlText::flush(int width, int height) {
+    size_t total = 0;
+    for (const QGlAtlasPage& page : this->pages)
+        total += page.quads.size();
+    this->stats.glyphs = this->stats.dropped = this->stats.draws = 0;
+    if (total == 0 || this->stream.getBuffer() == 0) {
+        this->clear();
+        return;
+    }
+
+    this->stream.beginFrame();
+    size_t count = min<size_t>(total, this->stream.getCapacity() / sizeof(QGlTextQuad));
+    QGlRingAllocation allocation = this->stream.allocate(count * sizeof(QGlTextQuad));
+    if (!allocation.valid()) {
+        this->stream.endFrame();
+        this->stats.dropped = total;
+        this->clear();
+        return;
+    }
+
+    QGlState& state = QGlState::current();
+    state.useProgram(this->program);
+    glUniform2f(this->viewportLocation, width, height);
+    state.bindVertexArray(this->vao);
+    this->stream.bind();
+    const struct { GLint components; GLenum type; GLboolean normalized; size_t offset; } attributes[] = {
+        { 4, GL_FLOAT,          GL_FALSE, offsetof(QGlTextQuad, x0)    },
+        { 4, GL_UNSIGNED_SHORT, GL_TRUE,  offsetof(QGlTextQuad, u0)    },
+        { 4, GL_UNSIGNED_BYTE,  GL_TRUE,  offsetof(QGlTextQuad, color) },
+    };
+    for (GLuint location = 0; location < 3; location++) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, attributes[location].components, attributes[location].type, attributes[location].normalized,
+                              sizeof(QGlTextQuad), (const void*) (allocation.offset + attributes[location].offset));
+        glVertexAttribDivisor(location, 1);
+    }
+    state.enable(GL_BLEND);
+    state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    state.disable(GL_DEPTH_TEST);
+    state.disable(GL_CULL_FACE);
+
+    QGlTextQuad* quads = (QGlTextQuad*) allocation.data;
+    size_t first = 0;
+    for (const QGlAtlasPage& page : this->pages) {
+        size_t n = min(page.quads.size(), count - first);
+        if (n == 0)
+            continue;
+        memcpy(quads + first, page.quads.data(), n * sizeof(QGlTextQuad));
+        state.bindTexture(0, GL_TEXTURE_2D, page.texture);
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, n, first);
+        first += n;
+        this->stats.draws++;
+    }
+    this->stream.endFrame();
+
+    this->stats.glyphs  = first;
+    this->stats.dropped = total - first;
+    this->clear();
+}
+
+
+/* Discards what was printed since the last flush. */
+void QGlText::clear() {
+    for (QGlAtlasPage& page : this->pages)
+        page.quads.clear();
+}
+
+#endif
@@ -0,0 +1,478 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    texture.cpp
+//
+// DESCRIPTION:
+// -----------
+// Asynchronous texture loading: images are decoded by the thread pool, and
+// uploaded through pixel unpack buffers within a budget of bytes per frame,
+// so that loading never stalls rendering.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/texture.hpp"
+#include "qgl/preprocessor.hpp"
+#include "qgl/threadpool.hpp"
+
+#ifdef QGL_STB_IMAGE
+    #include "stb_image.h"
+#endif
+
+#include <cstring>
+#include <algorithm>
+#include <thread>
+
+
+bool QGlTexture::isReady() const {
+    return this->data != nullptr && this->data->status == QGlTextureStatus::Ready;
+}
+
+
+bool QGlTexture::hasFailed() const {
+    return this->data != nullptr && this->data->status == QGlTextureStatus::Failed;
+}
+
+
+GLuint QGlTexture::getID() const {
+    return this->isReady() ? this->data->id : 0;
+}
+
+
+/* 0 while the image is being decoded. */
+int QGlTexture::getWidth() const {
+    return (this->data != nullptr && this->data->status != QGlTextureStatus::Decoding) ? this->data->width : 0;
+}
+
+
+int QGlTexture::getHeight() const {
+    return (this->data != nullptr && this->data->status != QGlTextureStatus::Decoding) ? this->data->height : 0;
+}
+
+
+string QGlTexture::getError() const {
+    return this->hasFailed() ? this->data->error : "";
+}
+
+
+void QGlTexture::bind(GLuint unit) const {
+    QGlState::current().bindTexture(unit, GL_TEXTURE_2D, this->getID());
+}
+
+
+/* Deletes the texture, or cancels its loading. Other handles to it become
+ * failed, with no error. */
+void QGlTexture::release() {
+    if (this->data == nullptr)
+        return;
+    QGlTextureStatus previous = this->data->status.exchange(QGlTextureStatus::Failed);
+    if (previous != QGlTextureStatus::Decoding && this->data->id != 0) {     // Else, the decoder still owns it
+        QGlState::current().forgetTexture(this->data->id);
+        glDeleteTextures(1, &this->data->id);
+        this->data->id = 0;
+    }
+    this->data.reset();
+}
+
+
+/* The smallest pooled buffer that fits, or a new one. */
+vector<uint8_t> QGlStagingPool::acquire(size_t size) {
+    {
+        lock_guard<mutex> guard(this->lock);
+        auto best = this->free.end();
+        for (auto it = this->free.begin(); it != this->free.end(); ++it)
+            if (it->capacity() >= size && (best == this->free.end() || it->capacity() < best->capacity()))
+                best = it;
+        if (best != this->free.end()) {
+            vector<uint8_t> buffer = move(*best);
+            this->free.erase(best);
+            this->pooled -= buffer.capacity();
+            buffer.resize(size);
+            return buffer;
+        }
+    }
+    return vector<uint8_t>(size);
+}
+
+
+/* Buffers beyond the limit of the pool are freed. */
+void QGlStagingPool::recycle(vector<uint8_t>&& buffer) {
+    lock_guard<mutex> guard(this->lock);
+    if (buffer.capacity() == 0 || this->pooled + buffer.capacity() > this->limit)
+        return;
+    this->pooled += buffer.capacity();
+    this->free.push_back(move(buffer));
+}
+
+
+/* KTX version 1 (khronos.org/ktx): the header, then each level, prefixed by
+ * its size and padded to 4 bytes, with rows padded to 4 bytes. */
+static const uint8_t QGL_KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct QGlKTXHeader {
+    uint32_t endianness;
+    uint32_t glType, glTypeSize, glFormat, glInternalFormat, glBaseInternalFormat;
+    uint32_t pixelWidth, pixelHeight, pixelDepth;
+    uint32_t numberOfArrayElements, numberOfFaces, numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+
+static bool QGlIsKTX(string_view bytes) {
+    return bytes.size() >= sizeof(QGL_KTX_IDENTIFIER) && memcmp(bytes.data(), QGL_KTX_IDENTIFIER, sizeof(QGL_KTX_IDENTIFIER)) == 0;
+}
+
+
+static bool QGlDecodeKTX(string_view bytes, QGlTextureData& texture, QGlStagingPool& staging) {
+    QGlKTXHeader header;
+    if (bytes.size() < sizeof(QGL_KTX_IDENTIFIER) + sizeof(header)) {
+        texture.error = "KTX: truncated header";
+        return false;
+    }
+    memcpy(&header, bytes.data() + sizeof(QGL_KTX_IDENTIFIER), sizeof(header));
+    if (header.endianness != 0x04030201) {
+        texture.error = "KTX: files of the other endianness are not supported";
+        return false;
+    }
+    if (header.pixelHeight == 0 || header.pixelDepth > 1 || header.numberOfArrayElements > 0 || header.numberOfFaces != 1) {
+        texture.error = "KTX: only 2D textures are supported";
+        return false;
+    }
+
+    texture.width          = header.pixelWidth;
+    texture.height         = header.pixelHeight;
+    texture.internalFormat = header.glInternalFormat;
+    texture.format         = header.glFormat;
+    texture.type           = header.glType;
+    texture.compressed     = (header.glType == 0);
+    texture.alignment      = 4;
+
+    // Sizes first, to copy the levels into one staging buffer
+    uint32_t levels = max<uint32_t>(header.numberOfMipmapLevels, 1);
+    size_t   start  = sizeof(QGL_KTX_IDENTIFIER) + sizeof(header) + header.bytesOfKeyValueData;
+    size_t   offset = start, total = 0;
+    for (uint32_t i = 0; i < levels; i++) {
+        uint32_t size;
+        if (offset + sizeof(size) > bytes.size()) {
+            texture.error = "KTX: truncated data";
+            return false;
+        }
+        memcpy(&size, bytes.data() + offset, sizeof(size));
+        offset += sizeof(size);
+        if (offset + size > bytes.size()) {
+            texture.error = "KTX: truncated data";
+            return false;
+        }
+
+        QGlTextureLevel level;
+        level.offset    = total;
+        level.size      = size;
+        level.width     = max(1, texture.width  >> i);
+        level.height    = max(1, texture.height >> i);
+        level.rowStride = texture.compressed ? 0 : size / level.height;
+        texture.levels.push_back(level);
+
+        total  += size;
+        offset += size + (3 - (size + 3) % 4);
+    }
+
+    texture.pixels = staging.acquire(total);
+    offset = start;
+    for (const QGlTextureLevel& level : texture.levels) {
+        offset += sizeof(uint32_t);
+        memcpy(texture.pixels.data() + level.offset, bytes.data() + offset, level.size);
+        offset += level.size + (3 - (level.size + 3) % 4);
+    }
+    return true;
+}
+
+
+#ifdef QGL_STB_IMAGE
+
+/* 8 bits per channel, or 16-bit floats for HDR images. Images are stored with
+ * the top row first: flipped, as OpenGL expects the bottom one first. */
+static bool QGlDecodeImage(string_view bytes, QGlTextureData& texture, QGlStagingPool& staging) {
+    const stbi_uc* input = (const stbi_uc*) bytes.data();
+    int   size     = (int) bytes.size();
+    bool  hdr      = stbi_is_hdr_from_memory(input, size);
+    int   channels = 0;
+    void* pixels   = hdr ? (void*) stbi_loadf_from_memory(input, size, &texture.width, &texture.height, &channels, 0)
+                         : (void*) stbi_load_from_memory(input, size, &texture.width, &texture.height, &channels, 0);
+    if (pixels == nullptr) {
+        texture.error = string("Image: ") + stbi_failure_reason();
+        return false;
+    }
+
+    static const GLenum formats[]  = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    static const GLenum unorm[]    = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    static const GLenum srgb[]     = { GL_R8, GL_RG8, GL_SRGB8, GL_SRGB8_ALPHA8 };
+    static const GLenum floating[] = { GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F };
+    texture.format         = formats[channels - 1];
+    texture.internalFormat = hdr ? floating[channels - 1] : (texture.options.srgb ? srgb : unorm)[channels - 1];
+    texture.type           = hdr ? GL_FLOAT : GL_UNSIGNED_BYTE;
+    texture.alignment      = 1;
+
+    size_t stride = size_t(texture.width) * channels * (hdr ? sizeof(float) : 1);
+    texture.pixels = staging.acquire(stride * texture.height);
+    for (int row = 0; row < texture.height; row++)
+        memcpy(texture.pixels.data() + row * stride, (uint8_t*) pixels + (texture.height - 1 - row) * stride, stride);
+    texture.levels.push_back({ 0, stride * texture.height, stride, texture.width, texture.height });
+
+    stbi_image_free(pixels);
+    return true;
+}
+
+#endif
+
+
+QGlTextureLoader::~QGlTextureLoader() {
+    unique_lock<mutex> guard(this->lock);
+    this->idle.wait(guard, [this]() { return this->decoding == 0; });
+}
+
+
+/* Bytes uploaded per frame at most (the size of each region of the pixel
+ * unpack buffer). Levels of compressed textures are uploaded whole, and so
+ * may exceed it. */
+QGlTextureLoader& QGlTextureLoader::withBudget(GLsizeiptr budget) {
+    this->budget  = max<GLsizeiptr>(budget, 1);
+    this->created = false;
+    return *this;
+}
+
+
+/* Starts loading the image: the texture is ready some frames later. */
+QGlTexture QGlTextureLoader::load(const fs::path& path, QGlTextureOptions options) {
+    shared_ptr<QGlTextureData> texture = make_shared<QGlTextureData>();
+    texture->path    = path;
+    texture->options = options;
+
+    this->decoding++;
+    QGlThreadPool::shared().submit([this, texture]() { this->decode(texture); });
+    return QGlTexture(texture);
+}
+
+
+/* On the thread pool: reads (mapping the file if possible) and decodes the
+ * image, then hands it to update(). */
+void QGlTextureLoader::decode(shared_ptr<QGlTextureData> texture) {
+    string error;
+    shared_ptr<QGlSourceFile> file = QGlSourceFile::open(texture->path, error);
+    bool decoded = false;
+    if (file == nullptr)
+        texture->error = error;
+    else if (QGlIsKTX(file->view()))
+        decoded = QGlDecodeKTX(file->view(), *texture, this->staging);
+    else
+#ifdef QGL_STB_IMAGE
+        decoded = QGlDecodeImage(file->view(), *texture, this->staging);
+#else
+        texture->error = "Unsupported format (only KTX without QGL_STB_IMAGE): " + texture->path.string();
+#endif
+    file.reset();
+
+    {
+        lock_guard<mutex> guard(this->lock);
+        QGlTextureStatus expected = QGlTextureStatus::Decoding;
+        QGlTextureStatus next     = decoded ? QGlTextureStatus::Uploading : QGlTextureStatus::Failed;
+        if (texture->status.compare_exchange_strong(expected, next))
+            this->decoded.push_back(texture);
+        else
+            this->staging.recycle(move(texture->pixels));   // Released meanwhile
+        this->decoding--;
+        this->idle.notify_all();        // Under the lock: the destructor may return as soon as it is released
+    }
+}
+
+
+/* Immutable storage for every level, mipmaps included. */
+bool QGlTextureLoader::allocate(QGlTextureData& texture) {
+    GLsizei levels = texture.levels.size();
+    texture.generateMipmaps = texture.options.mipmaps && levels == 1 && !texture.compressed;
+    if (texture.generateMipmaps)
+        while ((max(texture.width, texture.height) >> levels) > 0)
+            levels++;
+
+    while (glGetError() != GL_NO_ERROR);
+    glGenTextures(1, &texture.id);
+    QGlState::current().bindTexture(0, GL_TEXTURE_2D, texture.id);
+    glTexStorage2D(GL_TEXTURE_2D, levels, texture.internalFormat, texture.width, texture.height);
+    if (glGetError() != GL_NO_ERROR) {
+        texture.error = "Unsupported texture format or size: " + texture.path.string();
+        return false;
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture.options.wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, texture.options.wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return true;
+}
+
+
+/* Uploads as much of the texture as the budget left allows, at least a band
+ * of rows per frame: true once it is all uploaded. */
+bool QGlTextureLoader::upload(QGlTextureData& texture, GLsizeiptr& left) {
+    QGlState& state = QGlState::current();
+    state.bindTexture(0, GL_TEXTURE_2D, texture.id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, texture.alignment);
+
+    // On every return, even midway, uploads from client memory work as usual again
+    struct QGlUnpackRestore {
+        QGlState& state;
+        ~QGlUnpackRestore() {
+            state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+    } restore { state };
+
+    // Copies to the pixel unpack buffer, or uploads from memory if it is missing or full
+    auto stage = [&](size_t offset, size_t size) -> const void* {
+        QGlRingAllocation allocation = this->buffer.allocate(size);
+        if (!allocation.valid()) {
+            state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return texture.pixels.data() + offset;
+        }
+        memcpy(allocation.data, texture.pixels.data() + offset, size);
+        state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, this->buffer.getBuffer());
+        return (const void*) allocation.offset;
+    };
+
+    bool fresh = (left == this->budget);        // Nothing uploaded yet this frame
+    while (texture.level < texture.levels.size()) {
+        const QGlTextureLevel& level = texture.levels[texture.level];
+
+        if (level.rowStride == 0) {
+            if ((GLsizeiptr) level.size > left && !fresh)
+                return false;
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, texture.level, 0, 0, level.width, level.height,
+                                      texture.internalFormat, level.size, stage(level.offset, level.size));
+            left -= min<GLsizeiptr>(left, level.size);
+        } else {
+            int rows = min<GLsizeiptr>(level.height - texture.row, left / level.rowStride);
+            if (rows == 0 && !fresh)
+                return false;
+            rows = max(rows, 1);
+            size_t size = rows * level.rowStride;
+            glTexSubImage2D(GL_TEXTURE_2D, texture.level, 0, texture.row, level.width, rows,
+                            texture.format, texture.type, stage(level.offset + texture.row * level.rowStride, size));
+            left -= min<GLsizeiptr>(left, size);
+            texture.row += rows;
+        }
+        fresh = false;
+        if (texture.row == 0 || texture.row == level.height) {
+            texture.level++;
+            texture.row = 0;
+        }
+    }
+    return true;
+}
+
+
+/* The staging memory is no longer needed: uploads read it before returning,
+ * or read their copy in the pixel unpack buffer. */
+void QGlTextureLoader::finish(QGlTextureData& texture) {
+    if (texture.generateMipmaps) {
+        QGlState::current().bindTexture(0, GL_TEXTURE_2D, texture.id);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    texture.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    this->staging.recycle(move(texture.pixels));
+    texture.status = QGlTextureStatus::Fenced;
+}
+
+
+/* Once per frame, on the thread of the context: makes the textures whose
+ * upload the GPU finished ready, and uploads the next ones, within budget. */
+void QGlTextureLoader::update() {
+    if (!this->created) {
+        this->created = true;
+        this->buffer.release();
+        if (QGlRingBuffer::isSupported())       // Else, uploads read client memory
+            this->buffer.create(this->budget, GL_PIXEL_UNPACK_BUFFER);
+        QGlState::current().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    {
+        lock_guard<mutex> guard(this->lock);
+        for (shared_ptr<QGlTextureData>& texture : this->decoded)
+            this->uploading.push_back(move(texture));
+        this->decoded.clear();
+    }
+
+    for (auto it = this->fenced.begin(); it != this->fenced.end(); ) {
+        QGlTextureData& texture = **it;
+        GLenum result = (texture.status == QGlTextureStatus::Failed) ? GL_ALREADY_SIGNALED   // Released
+                                                                     : glClientWaitSync(texture.fence, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+            ++it;
+            continue;
+        }
+        glDeleteSync(texture.fence);
+        texture.fence = nullptr;
+        QGlTextureStatus expected = QGlTextureStatus::Fenced;
+        if (texture.status.compare_exchange_strong(expected, QGlTextureStatus::Ready))
+            this->stats.loaded++;
+        it = this->fenced.erase(it);
+    }
+
+    GLsizeiptr left = this->budget;
+    while (!this->uploading.empty() && left > 0) {
+        shared_ptr<QGlTextureData> texture = this->uploading.front();
+        if (texture->status == QGlTextureStatus::Uploading && texture->id == 0 && !this->allocate(*texture))
+            texture->status = QGlTextureStatus::Failed;
+        if (texture->status == QGlTextureStatus::Failed) {      // Decoding failed, or released
+            if (!texture->error.empty())
+                this->stats.failed++;
+            if (texture->id != 0) {                             // Its storage failed
+                QGlState::current().forgetTexture(texture->id);
+                glDeleteTextures(1, &texture->id);
+                texture->id = 0;
+            }
+            this->staging.recycle(move(texture->pixels));
+            this->uploading.pop_front();
+            continue;
+        }
+        if (!this->upload(*texture, left))
+            break;
+        this->finish(*texture);
+        this->fenced.push_back(texture);
+        this->uploading.pop_front();
+    }
+    this->buffer.endFrame();
+    this->stats.uploaded = this->budget - left;
+}
+
+
+/* Deletes the pixel unpack buffer, and cancels the textures still loading. */
+void QGlTextureLoader::release() {
+    lock_guard<mutex> guard(this->lock);
+    for (auto* queue : { &this->uploading, &this->decoded })
+        for (shared_ptr<QGlTextureData>& texture : *queue)
+            QGlTexture(texture).release();
+    for (shared_ptr<QGlTextureData>& texture : this->fenced) {
+        glDeleteSync(texture->fence);
+        QGlTexture(texture).release();
+    }
+    this->decoded.clear();
+    this->uploading.clear();
+    this->fenced.clear();
+    this->buffer.release();
+    this->created = false;
+}
+
+
+QGlTextureLoaderStats QGlTextureLoader::getStats() {
+    QGlTextureLoaderStats stats = this->stats;
+    lock_guard<mutex> guard(this->lock);
+    stats.pending = this->decoding + this->decoded.size() + this->uploading.size() + this->fenced.size();
+    return stats;
+}
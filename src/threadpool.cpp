@@ -0,0 +1,62 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    threadpool.cpp
+//
+// DESCRIPTION:
+// -----------
+// Minimal worker pool for CPU-side tasks (file reads, decoding...).
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/threadpool.hpp"
+
+
+QGlThreadPool::QGlThreadPool(unsigned count) {
+    if (count == 0)
+        count = 1;
+    for (unsigned i = 0; i < count; i++)
+        this->workers.emplace_back(&QGlThreadPool::work, this);
+}
+
+
+QGlThreadPool::~QGlThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->wakeup.notify_all();
+    for (std::thread& worker : this->workers)
+        worker.join();
+}
+
+
+void QGlThreadPool::work() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->wakeup.wait(guard, [this]() { return this->stopping || !this->tasks.empty(); });
+            if (this->stopping && this->tasks.empty())
+                return;
+            task = std::move(this->tasks.front());
+            this->tasks.pop();
+        }
+        task();
+    }
+}
+
+
+QGlThreadPool& QGlThreadPool::shared() {
+    static QGlThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,358 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    uniformbuffer.cpp
+//
+// DESCRIPTION:
+// -----------
+// Uniform buffer objects: the layout of an uniform block is reflected from a
+// program, its members are written into a CPU-side copy, and only the changed
+// ranges are uploaded, once per frame, for every program at once.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/uniformbuffer.hpp"
+
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+
+
+mutex                          QGlUniformBuffer::bindingsLock;
+unordered_map<string, GLuint>  QGlUniformBuffer::bindings;
+unordered_set<GLuint>          QGlUniformBuffer::reserved;
+
+
+/* Reflects the layout of the named block from a linked program that declares
+ * it, and creates the buffer bound to the binding point of the block.
+ * False if the program has no such block, or if no binding point is left (see
+ * getError()). */
+bool QGlUniformBuffer::create(GLuint program, const string& name) {
+    this->error.clear();
+    GLuint index = glGetUniformBlockIndex(program, name.c_str());
+    if (index == GL_INVALID_INDEX)
+        return false;
+
+    GLint limit = 0;
+    glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &limit);
+    {
+        lock_guard<mutex> guard(QGlUniformBuffer::bindingsLock);
+        QGlUniformBuffer::reserveBindings(program);
+        auto it = QGlUniformBuffer::bindings.find(name);
+        if (it == QGlUniformBuffer::bindings.end()) {
+            GLuint point = 1;
+            auto taken = [](GLuint point) {
+                if (QGlUniformBuffer::reserved.contains(point))
+                    return true;
+                for (auto& [block, binding] : QGlUniformBuffer::bindings)
+                    if (binding == point)
+                        return true;
+                return false;
+            };
+            while (taken(point))
+                point++;
+            if (point >= (GLuint) limit) {
+                this->error = "No uniform buffer binding point left for the block " + name
+                            + " (GL_MAX_UNIFORM_BUFFER_BINDINGS is " + to_string(limit) + ").";
+                return false;
+            }
+            it = QGlUniformBuffer::bindings.emplace(name, point).first;
+        }
+        this->binding = it->second;
+    }
+
+    this->release();
+    this->name = name;
+
+    GLint size = 0, count = 0;
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &count);
+    this->staging.assign(size, 0);
+
+    vector<GLint> indices(count);
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices.data());
+    vector<GLuint> uniforms(indices.begin(), indices.end());
+    vector<GLint>  offsets(count), arrayStrides(count), matrixStrides(count);
+    glGetActiveUniformsiv(program, count, uniforms.data(), GL_UNIFORM_OFFSET,        offsets.data());
+    glGetActiveUniformsiv(program, count, uniforms.data(), GL_UNIFORM_ARRAY_STRIDE,  arrayStrides.data());
+    glGetActiveUniformsiv(program, count, uniforms.data(), GL_UNIFORM_MATRIX_STRIDE, matrixStrides.data());
+
+    GLint maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    string buffer(maxLength, '\0');
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length = 0;
+        glGetActiveUniformName(program, uniforms[i], maxLength, &length, buffer.data());
+        string member = buffer.substr(0, length);
+
+        // Members of a block with an instance name are reported as "Block.member"
+        if (member.starts_with(name + "."))
+            member = member.substr(name.size() + 1);
+
+        QGlBlockMember location{ offsets[i], arrayStrides[i], matrixStrides[i] };
+        this->members[member] = location;
+        if (member.ends_with("[0]"))
+            this->members[member.substr(0, member.size() - 3)] = location;
+    }
+
+    glGenBuffers(1, &this->buffer);
+    QGlState::current().bindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+    glBufferData(GL_UNIFORM_BUFFER, size, this->staging.data(), GL_DYNAMIC_DRAW);
+    this->bind();
+    return true;
+}
+
+
+/* Reserves the binding points of the blocks of the program not managed by a
+ * QGlUniformBuffer, as given by layout(binding = N). Point 0 is the default
+ * binding of every block, and is never given anyway. Call with the lock held. */
+void QGlUniformBuffer::reserveBindings(GLuint program) {
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+
+    string name(maxLength, '\0');
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length = 0;
+        GLint   binding = 0;
+        glGetActiveUniformBlockName(program, i, maxLength, &length, name.data());
+        glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_BINDING, &binding);
+        if (binding > 0 && !QGlUniformBuffer::bindings.contains(name.substr(0, length)))
+            QGlUniformBuffer::reserved.insert(binding);
+    }
+}
+
+
+/* Binding point of the named block, if a buffer was ever created for it. */
+bool QGlUniformBuffer::findBinding(const string& name, GLuint& binding) {
+    lock_guard<mutex> guard(QGlUniformBuffer::bindingsLock);
+    auto it = QGlUniformBuffer::bindings.find(name);
+    if (it == QGlUniformBuffer::bindings.end())
+        return false;
+    binding = it->second;
+    return true;
+}
+
+
+/* Binds every block of the program managed by a QGlUniformBuffer to its
+ * binding point. Other blocks keep their binding (e.g. from the source), which
+ * is no longer given to new blocks. */
+void QGlUniformBuffer::bindBlocks(GLuint program) {
+    {
+        lock_guard<mutex> guard(QGlUniformBuffer::bindingsLock);
+        QGlUniformBuffer::reserveBindings(program);
+    }
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+
+    string name(maxLength, '\0');
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(program, i, maxLength, &length, name.data());
+        GLuint binding;
+        if (QGlUniformBuffer::findBinding(name.substr(0, length), binding))
+            glUniformBlockBinding(program, i, binding);
+    }
+}
+
+
+/* Uploads the changed ranges only. Does nothing if nothing changed. */
+void QGlUniformBuffer::upload() {
+    if (this->dirty.empty() || this->buffer == 0)
+        return;
+
+    QGlState::current().bindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+    for (auto [begin, end] : this->dirty) {
+        glBufferSubData(GL_UNIFORM_BUFFER, begin, end - begin, this->staging.data() + begin);
+        this->stats.uploads++;
+        this->stats.bytes += end - begin;
+    }
+    this->dirty.clear();
+}
+
+
+/* Binding points belong to each context: call it on every context sharing the
+ * buffer. Free when the buffer is bound already. */
+void QGlUniformBuffer::bind() {
+    QGlState::current().bindBufferBase(GL_UNIFORM_BUFFER, this->binding, this->buffer);
+}
+
+
+void QGlUniformBuffer::release() {
+    if (this->buffer != 0) {
+        QGlState::current().forgetBuffer(this->buffer);
+        glDeleteBuffers(1, &this->buffer);
+    }
+    this->buffer = 0;
+    this->members.clear();
+    this->dirty.clear();
+    this->staging.clear();
+}
+
+
+/* Ranges closer than this are merged, since a single larger upload is cheaper
+ * than two calls. Past MAX_DIRTY_RANGES, everything is merged in one range. */
+static const uint32_t QGL_DIRTY_GAP = 64;
+
+void QGlUniformBuffer::markDirty(uint32_t begin, uint32_t end) {
+    for (auto& range : this->dirty) {
+        if (begin <= range.second + QGL_DIRTY_GAP && range.first <= end + QGL_DIRTY_GAP) {
+            range.first  = min(range.first, begin);
+            range.second = max(range.second, end);
+            return;
+        }
+    }
+    this->dirty.emplace_back(begin, end);
+
+    if (this->dirty.size() > QGlUniformBuffer::MAX_DIRTY_RANGES) {
+        auto first = min_element(this->dirty.begin(), this->dirty.end());
+        uint32_t last = 0;
+        for (auto& range : this->dirty)
+            last = max(last, range.second);
+        this->dirty = { { first->first, last } };
+    }
+}
+
+
+/* Unchanged values are not marked dirty, so that writing the same data every
+ * frame costs no upload. */
+void QGlUniformBuffer::write(QGlBlockMember member, const void* data, size_t size) {
+    if (!member.valid() || member.offset + size > this->staging.size())
+        return;
+    uint8_t* target = this->staging.data() + member.offset;
+    if (memcmp(target, data, size) == 0) {
+        this->stats.skipped++;
+        return;
+    }
+    memcpy(target, data, size);
+    this->markDirty(member.offset, member.offset + size);
+}
+
+
+/* Column-major matrices: std140 pads each column to the matrix stride. */
+void QGlUniformBuffer::writeMatrix(QGlBlockMember member, const float* data, int columns, int rows) {
+    for (int c = 0; c < columns; c++) {
+        QGlBlockMember column = member;
+        column.offset += c * member.matrixStride;
+        this->write(column, data + c * rows, rows * sizeof(float));
+    }
+}
+
+
+/* Also resolves elements of arrays of basic types, e.g. "weights[3]". Invalid
+ * if the index is malformed. */
+QGlBlockMember QGlUniformBuffer::getMember(const string& name) const {
+    auto it = this->members.find(name);
+    if (it != this->members.end())
+        return it->second;
+
+    size_t open = name.rfind('[');
+    if (open == string::npos || !name.ends_with("]"))
+        return QGlBlockMember();
+    it = this->members.find(name.substr(0, open));
+    if (it == this->members.end())
+        return QGlBlockMember();
+
+    int         index = 0;
+    const char* end   = name.data() + name.size() - 1;
+    auto [ptr, ec] = from_chars(name.data() + open + 1, end, index);
+    if (ec != errc() || ptr != end || index < 0)
+        return QGlBlockMember();
+
+    QGlBlockMember element = it->second;
+    element.offset += index * element.arrayStride;
+    return element;
+}
+
+
+void QGlUniformBuffer::setBool(const string& name, bool value) {
+    this->setBool(this->getMember(name), value);
+}
+
+
+void QGlUniformBuffer::setInt(const string& name, int value) {
+    this->setInt(this->getMember(name), value);
+}
+
+
+void QGlUniformBuffer::setFloat(const string& name, float value) {
+    this->setFloat(this->getMember(name), value);
+}
+
+
+void QGlUniformBuffer::setVec2(const string& name, const glm::vec2& value) {
+    this->setVec2(this->getMember(name), value);
+}
+
+
+void QGlUniformBuffer::setVec3(const string& name, const glm::vec3& value) {
+    this->setVec3(this->getMember(name), value);
+}
+
+
+void QGlUniformBuffer::setVec4(const string& name, const glm::vec4& value) {
+    this->setVec4(this->getMember(name), value);
+}
+
+
+void QGlUniformBuffer::setMat3(const string& name, const glm::mat3& mat) {
+    this->setMat3(this->getMember(name), mat);
+}
+
+
+void QGlUniformBuffer::setMat4(const string& name, const glm::mat4& mat) {
+    this->setMat4(this->getMember(name), mat);
+}
+
+
+void QGlUniformBuffer::setBool(QGlBlockMember member, bool value) {
+    GLint data = value;     // Booleans take 4 bytes in std140
+    this->write(member, &data, sizeof(data));
+}
+
+
+void QGlUniformBuffer::setInt(QGlBlockMember member, int value) {
+    GLint data = value;
+    this->write(member, &data, sizeof(data));
+}
+
+
+void QGlUniformBuffer::setFloat(QGlBlockMember member, float value) {
+    this->write(member, &value, sizeof(value));
+}
+
+
+void QGlUniformBuffer::setVec2(QGlBlockMember member, const glm::vec2& value) {
+    this->write(member, &value[0], 2 * sizeof(float));
+}
+
+
+void QGlUniformBuffer::setVec3(QGlBlockMember member, const glm::vec3& value) {
+    this->write(member, &value[0], 3 * sizeof(float));
+}
+
+
+void QGlUniformBuffer::setVec4(QGlBlockMember member, const glm::vec4& value) {
+    this->write(member, &value[0], 4 * sizeof(float));
+}
+
+
+void QGlUniformBuffer::setMat3(QGlBlockMember member, const glm::mat3& mat) {
+    this->writeMatrix(member, &mat[0][0], 3, 3);
+}
+
+
+void QGlUniformBuffer::setMat4(QGlBlockMember member, const glm::mat4& mat) {
+    this->writeMatrix(member, &mat[0][0], 4, 4);
+}
@@ -0,0 +1,175 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    variants.cpp
+//
+// DESCRIPTION:
+// -----------
+// Permutations of a program that only differ in their #defines, compiled on
+// demand and cached by the bitmask of their defines.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/variants.hpp"
+#include "qgl/threadpool.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+
+
+QGlShaderVariants& QGlShaderVariants::withShaders(const string vertexPath, const string fragmentPath, const string geometryPath) {
+    this->base.withShaders(vertexPath, fragmentPath, geometryPath);
+    return *this;
+}
+
+
+QGlShaderVariants& QGlShaderVariants::withShaders(const string computePath) {
+    this->base.withShaders(computePath);
+    return *this;
+}
+
+
+/* Changing the keys changes the meaning of every mask: compiled variants are released. */
+QGlShaderVariants& QGlShaderVariants::withKeys(const vector<string>& keys) {
+    if (keys.size() > QGlShaderVariants::MAX_KEYS)
+        throw std::invalid_argument("Too many variant keys (64 at most).");
+    this->release();
+    this->keys = keys;
+    return *this;
+}
+
+
+/* Mask of the given keys, which must have been given to withKeys(). */
+uint64_t QGlShaderVariants::mask(initializer_list<string> names) const {
+    uint64_t bits = 0;
+    for (const string& name : names) {
+        auto it = find(this->keys.begin(), this->keys.end(), name);
+        if (it == this->keys.end())
+            throw std::invalid_argument("Unknown variant key: " + name);
+        bits |= uint64_t(1) << (it - this->keys.begin());
+    }
+    return bits;
+}
+
+
+QGlShader QGlShaderVariants::configure(uint64_t mask) const {
+    vector<string> defines;
+    for (size_t i = 0; i < this->keys.size(); i++)
+        if (mask & (uint64_t(1) << i))
+            defines.push_back(this->keys[i]);
+    QGlShader program = this->base.clone();
+    program.withDefines(defines);
+    return program;
+}
+
+
+/* Compiles the variant on first request, waiting for it if it was still
+ * being warmed. Check wasSuccessful() on the result. */
+QGlShader& QGlShaderVariants::get(uint64_t mask) {
+    auto it = this->variants.find(mask);
+    if (it == this->variants.end()) {
+        QGlVariant& variant = this->variants[mask];
+        variant.program = this->configure(mask);
+        variant.program.build();
+        variant.ready = true;
+        return variant.program;
+    }
+
+    QGlVariant& variant = it->second;
+    if (!variant.ready) {
+        if (!variant.submitted) {
+            variant.program = variant.sources.get();
+            if (variant.program.wasSuccessful())
+                variant.program.submit();
+        }
+        variant.program.finish();
+        variant.ready = true;
+    }
+    return variant.program;
+}
+
+
+QGlShader& QGlShaderVariants::use(uint64_t mask) {
+    QGlShader& program = this->get(mask);
+    program.use();
+    return program;
+}
+
+
+/* Tells if get() would return without compiling or waiting. */
+bool QGlShaderVariants::isReady(uint64_t mask) {
+    auto it = this->variants.find(mask);
+    return it != this->variants.end() && it->second.ready;
+}
+
+
+/* Starts preparing the given variants in the background. Requires a current
+ * context only for the variants already read when update() is called. */
+void QGlShaderVariants::warm(const vector<uint64_t>& masks) {
+    for (uint64_t mask : masks) {
+        if (this->variants.contains(mask))
+            continue;
+        QGlShader program = this->configure(mask);
+        QGlVariant& variant = this->variants[mask];
+        variant.sources = QGlThreadPool::shared().submit([program]() mutable {
+            program.readShaders();
+            return program;
+        });
+    }
+}
+
+
+/* Advances the warming variants without waiting: submits the ones whose
+ * sources were read, and finishes the ones the driver is done with. All are
+ * submitted before any is finished, so that they can share their stages. */
+void QGlShaderVariants::update() {
+    for (auto& [mask, variant] : this->variants) {
+        if (variant.ready || variant.submitted)
+            continue;
+        if (variant.sources.wait_for(chrono::seconds(0)) != future_status::ready)
+            continue;
+        variant.program = variant.sources.get();
+        if (!variant.program.wasSuccessful()) {     // Could not read: keep the report
+            variant.ready = true;
+            continue;
+        }
+        variant.program.submit();
+        variant.submitted = true;
+    }
+
+    for (auto& [mask, variant] : this->variants) {
+        if (variant.submitted && !variant.ready && variant.program.isReady()) {
+            variant.program.finish();
+            variant.ready = true;
+        }
+    }
+}
+
+
+void QGlShaderVariants::bindUniformBlocks() {
+    for (auto& [mask, variant] : this->variants)
+        if (variant.ready)
+            variant.program.bindUniformBlocks();
+}
+
+
+/* Deletes every compiled variant. Variants still being read are waited for. */
+void QGlShaderVariants::release() {
+    for (auto& [mask, variant] : this->variants) {
+        if (!variant.ready && !variant.submitted)
+            variant.sources.wait();
+        if (variant.submitted && !variant.ready)
+            variant.program.finish();
+        variant.program.release();
+    }
+    this->variants.clear();
+}
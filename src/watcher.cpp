@@ -0,0 +1,96 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// RUNTIME LIBRARIES PACKAGE
+//    watcher.cpp
+//
+// DESCRIPTION:
+// -----------
+// Non-blocking file change notifications (inotify on Linux).
+// On other systems, no change is ever reported.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/watcher.hpp"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+
+QGlFileWatcher::~QGlFileWatcher() {
+#ifdef __linux__
+    if (this->fd >= 0)
+        ::close(this->fd);
+#endif
+}
+
+
+/* Watches the parent directory rather than the file itself, since most editors
+ * save by replacing the file, which would silently end a watch on the file. */
+bool QGlFileWatcher::watch(const fs::path& path) {
+    fs::path file = fs::absolute(path).lexically_normal();
+    if (this->files.contains(file.string()))
+        return true;
+
+#ifdef __linux__
+    if (this->fd < 0)
+        this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (this->fd < 0)
+        return false;
+
+    fs::path directory = file.parent_path();
+    int wd = inotify_add_watch(this->fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd < 0)
+        return false;
+    this->directories[wd] = directory;
+#endif
+
+    this->files.insert(file.string());
+    return true;
+}
+
+
+bool QGlFileWatcher::isWatching(const fs::path& path) {
+    return this->files.contains(fs::absolute(path).lexically_normal().string());
+}
+
+
+vector<fs::path> QGlFileWatcher::poll() {
+    vector<fs::path> changed;
+#ifdef __linux__
+    if (this->fd < 0)
+        return changed;
+
+    alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    unordered_set<string> seen;     // A single save usually raises several events
+    for (;;) {
+        ssize_t length = read(this->fd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+
+        for (char* ptr = buffer; ptr < buffer + length; ) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+
+            auto dir = this->directories.find(event->wd);
+            if (dir == this->directories.end() || event->len == 0)
+                continue;
+            string file = (dir->second / event->name).string();
+            if (this->files.contains(file) && seen.insert(file).second)
+                changed.push_back(file);
+        }
+    }
+#endif
+    return changed;
+}
@@ -0,0 +1,238 @@
+//------------------------------------------------------------------------------
+//
+// quickGL - A quick and easy to use OpenGL wrapper
+//
+// TOOLS
+//    obj2qglm.cpp
+//
+// DESCRIPTION:
+// -----------
+// Converts Wavefront OBJ models to the binary mesh format of quickGL (.qglm),
+// offline, so that applications load them without parsing.
+//
+//     obj2qglm model.obj model.qglm
+//
+// Faces are triangulated as fans, and identical position/texture/normal
+// triples are shared between them. Vertices are laid out as:
+//     location 0: position (vec3)
+//     location 1: normal (vec3), if the model has normals
+//     location 2: texture coordinates (vec2), if the model has them
+// Materials, groups and smoothing groups are ignored.
+//
+// AUTHORS:
+// -------
+//      Igor Nunes (https://github.com/thoga31)
+//
+// LICENSE:
+// -------
+//      GNU GPL V3.0
+//------------------------------------------------------------------------------
+
+#include "qgl/mesh.hpp"
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <charconv>
+#include <cfloat>
+#include <cstring>
+#include <chrono>
+
+using namespace std;
+
+
+struct QGlObjCorner {
+    int32_t position, texcoord, normal;         // 0-based, -1 if absent
+
+    bool operator==(const QGlObjCorner& other) const {
+        return position == other.position && texcoord == other.texcoord && normal == other.normal;
+    }
+};
+
+struct QGlObjCornerHash {
+    size_t operator()(const QGlObjCorner& c) const {
+        return (uint64_t(uint32_t(c.position)) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(uint32_t(c.texcoord)) << 21) ^ uint32_t(c.normal);
+    }
+};
+
+
+static const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+static const char* parseFloat(const char* p, const char* end, float& value) {
+    p = skipSpaces(p, end);
+    if (p < end && *p == '+')
+        p++;
+    from_chars_result result = from_chars(p, end, value);
+    if (result.ec != errc())
+        value = 0.0f;
+    return result.ptr;
+}
+
+/* OBJ indices are 1-based, or negative (relative to the end): -1 if absent. */
+static const char* parseIndex(const char* p, const char* end, size_t count, int32_t& index) {
+    long value = 0;
+    from_chars_result result = from_chars(p, end, value);
+    index = (result.ec != errc() || value == 0) ? -1 : (value > 0 ? value - 1 : long(count) + value);
+    return result.ptr;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " <input.obj> <output.qglm>" << endl;
+        return 1;
+    }
+    auto start = chrono::steady_clock::now();
+
+    string error;
+    shared_ptr<QGlSourceFile> file = QGlSourceFile::open(argv[1], error);
+    if (file == nullptr) {
+        cerr << error << endl;
+        return 1;
+    }
+    string_view text = file->view();
+
+    vector<float> positions, texcoords, normals;
+    vector<QGlObjCorner> corners;                       // Three per triangle
+    vector<QGlObjCorner> face;
+    size_t invalid = 0;
+
+    const char* p   = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        const char* eol = (const char*) memchr(p, '\n', end - p);
+        if (eol == nullptr)
+            eol = end;
+        const char* q = skipSpaces(p, eol);
+
+        if (eol - q > 2 && q[0] == 'v' && (q[1] == ' ' || q[1] == '\t')) {
+            float v[3];
+            q += 1;
+            for (float& f : v) q = parseFloat(q, eol, f);
+            positions.insert(positions.end(), v, v + 3);
+        } else if (eol - q > 3 && q[0] == 'v' && q[1] == 't' && (q[2] == ' ' || q[2] == '\t')) {
+            float v[2];
+            q += 2;
+            for (float& f : v) q = parseFloat(q, eol, f);
+            texcoords.insert(texcoords.end(), v, v + 2);
+        } else if (eol - q > 3 && q[0] == 'v' && q[1] == 'n' && (q[2] == ' ' || q[2] == '\t')) {
+            float v[3];
+            q += 2;
+            for (float& f : v) q = parseFloat(q, eol, f);
+            normals.insert(normals.end(), v, v + 3);
+        } else if (eol - q > 2 && q[0] == 'f' && (q[1] == ' ' || q[1] == '\t')) {
+            face.clear();
+            q += 1;
+            for (q = skipSpaces(q, eol); q < eol && *q != '\r' && *q != '#'; q = skipSpaces(q, eol)) {
+                QGlObjCorner corner { -1, -1, -1 };
+                q = parseIndex(q, eol, positions.size() / 3, corner.position);
+                if (q < eol && *q == '/') {
+                    q = parseIndex(q + 1, eol, texcoords.size() / 2, corner.texcoord);
+                    if (q < eol && *q == '/')
+                        q = parseIndex(q + 1, eol, normals.size() / 3, corner.normal);
+                }
+                while (q < eol && *q != ' ' && *q != '\t' && *q != '\r')     // Skips what could not be parsed
+                    q++;
+                if (corner.position < 0 || size_t(corner.position) >= positions.size() / 3
+                        || size_t(corner.texcoord + 1) > texcoords.size() / 2
+                        || size_t(corner.normal + 1) > normals.size() / 3) {
+                    invalid++;
+                    face.clear();
+                    break;
+                }
+                face.push_back(corner);
+            }
+            for (size_t i = 2; i < face.size(); i++) {
+                corners.push_back(face[0]);
+                corners.push_back(face[i - 1]);
+                corners.push_back(face[i]);
+            }
+        }
+        p = eol + 1;
+    }
+    file.reset();
+
+    if (corners.empty()) {
+        cerr << argv[1] << ": no faces" << endl;
+        return 1;
+    }
+
+    // Layout: the attributes present in every face
+    bool hasNormals = true, hasTexcoords = true;
+    for (const QGlObjCorner& corner : corners) {
+        hasNormals   &= corner.normal >= 0;
+        hasTexcoords &= corner.texcoord >= 0;
+    }
+
+    QGlMeshHeader header {};
+    header.mode = GL_TRIANGLES;
+    uint32_t stride = 0;
+    auto addAttribute = [&](uint8_t location, uint8_t components) {
+        header.attributes[header.attributeCount++] = QGlMeshAttribute { location, components, 0, 0, GL_FLOAT, stride };
+        stride += components * sizeof(float);
+    };
+    addAttribute(0, 3);
+    if (hasNormals)
+        addAttribute(1, 3);
+    if (hasTexcoords)
+        addAttribute(2, 2);
+    header.vertexStride = stride;
+
+    // Shares identical corners
+    unordered_map<QGlObjCorner, uint32_t, QGlObjCornerHash> shared;
+    shared.reserve(corners.size());
+    vector<float>    vertices;
+    vector<uint32_t> indices;
+    indices.reserve(corners.size());
+    for (float& f : header.boundsMin) f = FLT_MAX;
+    for (float& f : header.boundsMax) f = -FLT_MAX;
+
+    for (QGlObjCorner corner : corners) {
+        if (!hasNormals)   corner.normal   = -1;
+        if (!hasTexcoords) corner.texcoord = -1;
+        auto [it, added] = shared.try_emplace(corner, uint32_t(shared.size()));
+        indices.push_back(it->second);
+        if (!added)
+            continue;
+
+        const float* position = &positions[corner.position * 3];
+        vertices.insert(vertices.end(), position, position + 3);
+        for (int i = 0; i < 3; i++) {
+            header.boundsMin[i] = min(header.boundsMin[i], position[i]);
+            header.boundsMax[i] = max(header.boundsMax[i], position[i]);
+        }
+        if (hasNormals)
+            vertices.insert(vertices.end(), &normals[corner.normal * 3], &normals[corner.normal * 3] + 3);
+        if (hasTexcoords)
+            vertices.insert(vertices.end(), &texcoords[corner.texcoord * 2], &texcoords[corner.texcoord * 2] + 2);
+    }
+    header.vertexCount = shared.size();
+    header.indexCount  = indices.size();
+
+    // 16-bit indices when they fit
+    vector<uint16_t> shortIndices;
+    const void* indexData = indices.data();
+    header.indexType = GL_UNSIGNED_INT;
+    if (header.vertexCount <= 0x10000) {
+        shortIndices.assign(indices.begin(), indices.end());
+        indexData = shortIndices.data();
+        header.indexType = GL_UNSIGNED_SHORT;
+    }
+
+    if (!QGlMeshFile::write(argv[2], header, vertices.data(), indexData, error)) {
+        cerr << error << endl;
+        return 1;
+    }
+
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << argv[2] << ": " << header.vertexCount << " vertices, " << header.indexCount / 3 << " triangles"
+         << (hasNormals ? ", normals" : "") << (hasTexcoords ? ", texture coordinates" : "")
+         << " (" << elapsed << " s)" << endl;
+    if (invalid > 0)
+        cerr << "Skipped " << invalid << " faces with invalid indices" << endl;
+    return 0;
+}